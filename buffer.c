@@ -19,10 +19,28 @@ static int _buffer_bline_unslab(bline_t *self);
 static void _buffer_stat(buffer_t *self);
 static int _buffer_baction_do(buffer_t *self, bline_t *bline, baction_t *action, int is_redo, bint_t *opt_repeat_offset);
 static int _buffer_update(buffer_t *self, baction_t *action);
+static void _buffer_prepare_edit(buffer_t *self, bline_t *bline);
+static void _buffer_renumber_lines(buffer_t *self, bline_t *bline);
 static int _buffer_undo(buffer_t *self, int by_group);
 static int _buffer_redo(buffer_t *self, int by_group);
+static int _buffer_undo_by_time(buffer_t *self, int is_later, int by_group);
+static int _buffer_undo_to(buffer_t *self, baction_t *target);
+static baction_t *_buffer_get_applied_action(buffer_t *self);
 static int _buffer_truncate_undo_stack(buffer_t *self, baction_t *action_from);
 static int _buffer_add_to_undo_stack(buffer_t *self, baction_t *action);
+static int _buffer_coalesce_baction(buffer_t *self, baction_t *action);
+static void _buffer_cap_undo_stack(buffer_t *self);
+static void _buffer_branch_undo_stack(buffer_t *self);
+static void _buffer_switch_to_branch(buffer_t *self, baction_branch_t *branch);
+static baction_branch_t **_buffer_get_branches_at(buffer_t *self, baction_t *parent);
+static void _buffer_unlink_undo_branch(buffer_t *self, baction_branch_t *branch);
+static void _buffer_free_undo_branch(buffer_t *self, baction_branch_t *branch);
+static void _buffer_free_undo_branches_at(buffer_t *self, baction_t *parent);
+static void _buffer_free_baction(buffer_t *self, baction_t *action);
+static bint_t _baction_get_size(baction_t *action);
+static void _buffer_journal_baction(buffer_t *self, baction_t *action);
+static int _buffer_unjournal_baction(buffer_t *self, baction_t *action);
+static void _buffer_close_undo_journal(buffer_t *self);
 static int _buffer_apply_styles_all(bline_t *bline, bint_t min_nlines);
 static int _buffer_match_srule(bline_t *bline, bint_t look_offset, srule_t *srule, int end_rule, bint_t *ret_start, bint_t *ret_stop);
 static void _buffer_bline_reset_styles(bline_t *bline);
@@ -32,25 +50,35 @@ static int _buffer_bline_free(bline_t *bline, bline_t *maybe_mark_line, bint_t c
 static bline_t *_buffer_bline_break(bline_t *bline, bint_t col);
 static void _buffer_find_end_pos(bline_t *start_line, bint_t start_col, bint_t num_chars, bline_t **ret_end_line, bint_t *ret_end_col, bint_t *ret_safe_num_chars);
 static void _buffer_bline_replace(bline_t *bline, bint_t start_col, char *data, bint_t data_len, str_t *del_data);
+static bint_t _buffer_bline_match_all(bline_t *bline, bint_t look_offset, bint_t stop_offset, pcre2_code *cre, char *repl, str_t *ret_data, bint_t **offsets, bint_t *offsets_cap);
+static bline_t *_buffer_bline_apply_all(bline_t *bline, str_t *data, bint_t *offsets, bint_t num_matches, bint_t *ret_num_lines_added);
 static bint_t _buffer_bline_insert(bline_t *bline, bint_t col, char *data, bint_t data_len, int move_marks);
 static bint_t _buffer_bline_delete(bline_t *bline, bint_t col, bint_t num_chars);
 static bint_t _buffer_bline_col_to_index(bline_t *bline, bint_t col);
 static bint_t _buffer_bline_index_to_col(bline_t *bline, bint_t index);
+static int _buffer_mark_cmp_col(mark_t *a, mark_t *b);
 static int _buffer_munmap(buffer_t *self);
+static void _buffer_reset(buffer_t *self);
 static int _baction_destroy(baction_t *action);
 static void _bline_advance_col(bline_t **self, bint_t *col);
 
+static bint_t bline_version = 0;
+
 // Make a new buffer and return it
 buffer_t *buffer_new(void) {
     buffer_t *buffer;
     bline_t *bline;
     buffer = calloc(1, sizeof(buffer_t));
     buffer->tab_width = 4;
+    pool_init(&buffer->bline_pool, sizeof(bline_t), MLBUF_POOL_SLAB_NOBJS);
+    pool_init(&buffer->mark_pool, sizeof(mark_t), MLBUF_POOL_SLAB_NOBJS);
+    pool_init(&buffer->baction_pool, sizeof(baction_t), MLBUF_POOL_SLAB_NOBJS);
     bline = _buffer_bline_new(buffer);
     buffer->first_line = bline;
     buffer->last_line = bline;
     buffer->line_count = 1;
     buffer->mmap_fd = -1;
+    buffer->undo_journal_fd = -1;
     return buffer;
 }
 
@@ -197,26 +225,40 @@ int buffer_write_to_fd(buffer_t *self, int fd, size_t *optret_nbytes) {
     return MLBUF_OK;
 }
 
-// Free a buffer
+// Free a buffer. Lines, marks, and actions go back in bulk with their pools.
 int buffer_destroy(buffer_t *self) {
     bline_t *line;
-    bline_t *line_tmp;
     baction_t *action;
-    baction_t *action_tmp;
+    baction_branch_t *branch;
+    baction_branch_t *branch_tmp;
     char c;
-    for (line = self->last_line; line; ) {
-        line_tmp = line->prev;
-        _buffer_bline_free(line, NULL, 0);
-        line = line_tmp;
+    for (line = self->first_line; line; line = line->next) {
+        if (!line->is_data_slabbed) {
+            if (line->data) free(line->data);
+            if (line->chars) free(line->chars);
+        }
+        if (line->brackets) free(line->brackets);
     }
+    while (self->range_srules) buffer_remove_srule(self, self->range_srules->srule);
     if (self->data) free(self->data);
     if (self->path) free(self->path);
-    DL_FOREACH_SAFE(self->actions, action, action_tmp) {
-        DL_DELETE(self->actions, action);
-        _baction_destroy(action);
+    DL_FOREACH_SAFE(self->undo_branches, branch, branch_tmp) {
+        DL_FOREACH(branch->actions, action) {
+            if (action->data) free(action->data);
+            if (action->del_data) free(action->del_data);
+        }
+        free(branch);
+    }
+    DL_FOREACH(self->actions, action) {
+        if (action->data) free(action->data);
+        if (action->del_data) free(action->del_data);
     }
     for (c = 'a'; c <= 'z'; c++) buffer_register_clear(self, c);
     _buffer_munmap(self);
+    if (self->undo_journal_fd >= 0) close(self->undo_journal_fd);
+    pool_destroy(&self->bline_pool);
+    pool_destroy(&self->mark_pool);
+    pool_destroy(&self->baction_pool);
     if (self->slabbed_blines) free(self->slabbed_blines);
     if (self->slabbed_chars) free(self->slabbed_chars);
     free(self);
@@ -237,7 +279,7 @@ mark_t *buffer_add_mark_ex(buffer_t *self, char letter, bline_t *maybe_line, bin
     if (!((letter >= 'a' && letter <= 'z') || letter == '\0')) {
         return NULL;
     }
-    mark = calloc(1, sizeof(mark_t));
+    mark = pool_alloc(&self->mark_pool);
     mark->letter = letter;
     MLBUF_MAKE_GT_EQ0(maybe_col);
     if (maybe_line != NULL) {
@@ -248,7 +290,7 @@ mark_t *buffer_add_mark_ex(buffer_t *self, char letter, bline_t *maybe_line, bin
         mark->bline = self->first_line;
         mark->col = 0;
     }
-    DL_APPEND(mark->bline->marks, mark);
+    _mark_mark_link(mark, NULL);
     if (mark->letter) {
         if ((mark_tmp = MLBUF_LETT_MARK(self, mark->letter)) != NULL) {
             buffer_destroy_mark(self, mark_tmp);
@@ -278,7 +320,7 @@ int buffer_destroy_mark(buffer_t *self, mark_t *mark) {
             buffer_remove_srule(self, node->srule);
         }
     }
-    free(mark);
+    pool_free(&self->mark_pool, mark);
     return MLBUF_OK;
 }
 
@@ -322,9 +364,7 @@ int buffer_clear(buffer_t *self) {
 int buffer_set(buffer_t *self, char *data, bint_t data_len) {
     int rc;
     MLBUF_MAKE_GT_EQ0(data_len);
-    if ((rc = buffer_clear(self)) != MLBUF_OK) {
-        return rc;
-    }
+    _buffer_reset(self);
     rc = buffer_insert(self, 0, data, data_len, NULL);
     if (self->actions) _buffer_truncate_undo_stack(self, self->actions);
     return rc;
@@ -340,9 +380,7 @@ int buffer_set_mmapped(buffer_t *self, char *data, bint_t data_len) {
     char *data_newline;
     bint_t line_len;
 
-    if (buffer_clear(self) != MLBUF_OK) {
-        return MLBUF_ERR;
-    }
+    _buffer_reset(self);
 
     // Count number of lines
     nlines = 1;
@@ -401,7 +439,7 @@ int buffer_set_mmapped(buffer_t *self, char *data, bint_t data_len) {
         }
     }
 
-    if (self->first_line) _buffer_bline_free(self->first_line, NULL, 0);
+    _buffer_bline_free(self->first_line, blines, 0); // Moves marks to blines
     self->first_line = blines;
     self->last_line = blines + line_num;
     self->byte_count = data_len;
@@ -440,6 +478,7 @@ int buffer_insert_w_bline(buffer_t *self, bline_t *start_line, bint_t start_col,
     bint_t ins_data_nchars;
     baction_t *action;
     MLBUF_MAKE_GT_EQ0(data_len);
+    _buffer_prepare_edit(self, start_line);
 
     // Exit early if no data
     if (data_len < 1) {
@@ -472,7 +511,7 @@ int buffer_insert_w_bline(buffer_t *self, bline_t *start_line, bint_t start_col,
     buffer_substr(self, start_line, start_col, cur_line, cur_col, &ins_data, &ins_data_len, &ins_data_nchars);
 
     // Add baction
-    action = calloc(1, sizeof(baction_t));
+    action = pool_alloc(&self->baction_pool);
     action->type = MLBUF_BACTION_TYPE_INSERT;
     action->buffer = self;
     action->start_line = start_line;
@@ -517,6 +556,7 @@ int buffer_delete_w_bline(buffer_t *self, bline_t *start_line, bint_t start_col,
     bint_t orig_char_count;
     baction_t *action;
     MLBUF_MAKE_GT_EQ0(num_chars);
+    _buffer_prepare_edit(self, start_line);
 
     // Find end line and col
     _buffer_find_end_pos(start_line, start_col, num_chars, &end_line, &end_col, &num_chars);
@@ -568,7 +608,7 @@ int buffer_delete_w_bline(buffer_t *self, bline_t *start_line, bint_t start_col,
     if (swap_line) swap_line->prev = start_line;
 
     // Add baction
-    action = calloc(1, sizeof(baction_t));
+    action = pool_alloc(&self->baction_pool);
     action->type = MLBUF_BACTION_TYPE_DELETE;
     action->buffer = self;
     action->start_line = start_line;
@@ -612,6 +652,7 @@ int buffer_replace_w_bline(buffer_t *self, bline_t *start_line, bint_t start_col
     char *data_newline;
     baction_t *action;
     str_t del_data = {0};
+    _buffer_prepare_edit(self, start_line);
 
     // Replace data on common lines
     insert_rem = data_len;
@@ -648,7 +689,7 @@ int buffer_replace_w_bline(buffer_t *self, bline_t *start_line, bint_t start_col
 
     // Add delete baction
     if (del_data.len > 0) {
-        action = calloc(1, sizeof(baction_t));
+        action = pool_alloc(&self->baction_pool);
         action->type = MLBUF_BACTION_TYPE_DELETE;
         action->buffer = self;
         action->start_line = start_line;
@@ -664,7 +705,7 @@ int buffer_replace_w_bline(buffer_t *self, bline_t *start_line, bint_t start_col
 
     // Add insert baction
     if (data_len - insert_rem > 0) {
-        action = calloc(1, sizeof(baction_t));
+        action = pool_alloc(&self->baction_pool);
         action->type = MLBUF_BACTION_TYPE_INSERT;
         action->buffer = self;
         action->start_line = start_line;
@@ -694,6 +735,122 @@ int buffer_replace_w_bline(buffer_t *self, bline_t *start_line, bint_t start_col
     return MLBUF_OK;
 }
 
+// Replace all matches of cre from start_line:start_col up to end_line:end_col
+// in one pass. Each affected line is rebuilt once and the whole edit is
+// recorded as a single MLBUF_BACTION_TYPE_REPLACE action.
+int buffer_replace_all_cre(buffer_t *self, bline_t *start_line, bint_t start_col, bline_t *end_line, bint_t end_col, pcre2_code *cre, char *repl, bint_t *optret_num_repls) {
+    bline_t *bline;
+    bline_t *next_line;
+    bline_t *tmp_line;
+    bline_t *first_line;
+    bline_t *last_line;
+    bint_t look_offset;
+    bint_t stop_offset;
+    bint_t num_matches;
+    bint_t num_repls;
+    bint_t num_lines_added;
+    bint_t line_delta;
+    bint_t del_nlines;
+    bint_t del_nchars;
+    bint_t *offsets;
+    bint_t offsets_cap;
+    char *ins_data;
+    bint_t ins_data_len;
+    bint_t ins_data_nchars;
+    baction_t *action;
+    str_t line_data = {0};
+    str_t del_data = {0};
+    MLBUF_MAKE_GT_EQ0(start_col);
+    MLBUF_MAKE_GT_EQ0(end_col);
+    if (self->transaction_line) _buffer_renumber_lines(self, self->transaction_line); // Compares end_line
+    _buffer_prepare_edit(self, start_line);
+
+    if (optret_num_repls) *optret_num_repls = 0;
+    if (start_line->line_index > end_line->line_index
+        || (start_line == end_line && start_col > end_col)
+    ) {
+        return MLBUF_ERR;
+    }
+
+    first_line = NULL;
+    last_line = NULL;
+    num_repls = 0;
+    line_delta = 0;
+    del_nlines = 0;
+    del_nchars = 0;
+    offsets = NULL;
+    offsets_cap = 0;
+
+    for (bline = start_line; bline; bline = next_line) {
+        next_line = bline->next;
+        look_offset = bline == start_line ? _buffer_bline_col_to_index(bline, start_col) : 0;
+        stop_offset = bline == end_line ? _buffer_bline_col_to_index(bline, end_col) : bline->data_len + 1;
+        num_matches = _buffer_bline_match_all(bline, look_offset, stop_offset, cre, repl, &line_data, &offsets, &offsets_cap);
+        if (num_matches > 0) {
+            // Store replaced data, including unchanged lines since the
+            // previous replacement
+            if (last_line) {
+                for (tmp_line = last_line->next; tmp_line != bline; tmp_line = tmp_line->next) {
+                    MLBUF_BLINE_ENSURE_CHARS(tmp_line);
+                    str_append_char(&del_data, '\n');
+                    str_append_len(&del_data, tmp_line->data, tmp_line->data_len);
+                    del_nchars += tmp_line->char_count + 1;
+                    del_nlines += 1;
+                }
+                str_append_char(&del_data, '\n');
+                del_nchars += 1;
+                del_nlines += 1;
+            } else {
+                first_line = bline;
+            }
+            MLBUF_BLINE_ENSURE_CHARS(bline);
+            str_append_len(&del_data, bline->data, bline->data_len);
+            del_nchars += bline->char_count;
+
+            // Rebuild line
+            last_line = _buffer_bline_apply_all(bline, &line_data, offsets, num_matches, &num_lines_added);
+            line_delta += num_lines_added;
+            num_repls += num_matches;
+        }
+        if (bline == end_line) break;
+    }
+
+    if (offsets) free(offsets);
+    str_free(&line_data);
+
+    if (num_repls < 1) {
+        str_free(&del_data);
+        return MLBUF_OK;
+    }
+
+    // Get inserted data
+    MLBUF_BLINE_ENSURE_CHARS(last_line);
+    buffer_substr(self, first_line, 0, last_line, last_line->char_count, &ins_data, &ins_data_len, &ins_data_nchars);
+
+    // Add baction
+    action = pool_alloc(&self->baction_pool);
+    action->type = MLBUF_BACTION_TYPE_REPLACE;
+    action->buffer = self;
+    action->start_line = first_line;
+    action->start_line_index = first_line->line_index;
+    action->start_col = 0;
+    action->maybe_end_line = last_line;
+    action->maybe_end_line_index = action->start_line_index + del_nlines + line_delta;
+    action->maybe_end_col = last_line->char_count;
+    action->byte_delta = ins_data_len - (bint_t)del_data.len;
+    action->char_delta = ins_data_nchars - del_nchars;
+    action->line_delta = line_delta;
+    action->data = ins_data;
+    action->data_len = ins_data_len;
+    action->del_data = del_data.data;
+    action->del_data_len = (bint_t)del_data.len;
+    action->del_nchars = del_nchars;
+    _buffer_update(self, action);
+    if (optret_num_repls) *optret_num_repls = num_repls;
+
+    return MLBUF_OK;
+}
+
 // Return a line given a line_index
 int buffer_get_bline(buffer_t *self, bint_t line_index, bline_t **ret_bline) {
     return buffer_get_bline_w_hint(self, line_index, self->first_line, ret_bline);
@@ -703,6 +860,7 @@ int buffer_get_bline(buffer_t *self, bint_t line_index, bline_t **ret_bline) {
 int buffer_get_bline_w_hint(buffer_t *self, bint_t line_index, bline_t *opt_hint, bline_t **ret_bline) {
     bline_t *fwd, *rev, *found;
     MLBUF_MAKE_GT_EQ0(line_index);
+    if (self->transaction_line) _buffer_renumber_lines(self, self->transaction_line);
 
     if (!opt_hint) {
         opt_hint = self->first_line;
@@ -842,6 +1000,66 @@ int buffer_remove_srule(buffer_t *self, srule_t *srule) {
     return buffer_apply_styles(self, self->first_line, self->line_count - 1);
 }
 
+// Clip range style rules to nlines lines starting at line_index. Spans of
+// line `line_index + i` are linked from (*ret_heads)[i] in rule order. Caller
+// frees both arrays.
+int buffer_get_range_spans(buffer_t *self, bint_t line_index, bint_t nlines, int is_block, srule_span_t **ret_spans, int **ret_heads) {
+    srule_node_t *node;
+    srule_span_t *spans;
+    srule_span_t *span;
+    size_t spans_len;
+    size_t spans_cap;
+    int *heads;
+    int *tails;
+    mark_t *a, *b;
+    bint_t first, last, i;
+    bint_t start_col, end_col;
+
+    spans = NULL;
+    spans_len = 0;
+    spans_cap = 0;
+    heads = malloc(sizeof(int) * (size_t)MLBUF_MAX(nlines, 1));
+    tails = malloc(sizeof(int) * (size_t)MLBUF_MAX(nlines, 1));
+    for (i = 0; i < nlines; i++) heads[i] = tails[i] = -1;
+
+    DL_FOREACH(self->range_srules, node) {
+        mark_cmp(node->srule->range_a, node->srule->range_b, &a, &b);
+        first = MLBUF_MAX(a->bline->line_index, line_index);
+        last = MLBUF_MIN(b->bline->line_index, line_index + nlines - 1);
+        for (i = first; i <= last; i++) {
+            if (is_block) {
+                start_col = MLBUF_MIN(a->col, b->col);
+                end_col = MLBUF_MAX(a->col, b->col);
+            } else {
+                start_col = i == a->bline->line_index ? a->col : 0;
+                end_col = i == b->bline->line_index ? b->col : -1;
+            }
+            if (end_col >= 0 && start_col >= end_col) continue;
+            if (spans_len >= spans_cap) {
+                spans_cap = spans_cap ? spans_cap * 2 : 16;
+                spans = realloc(spans, sizeof(srule_span_t) * spans_cap);
+            }
+            span = &spans[spans_len];
+            span->srule = node->srule;
+            span->start_col = start_col;
+            span->end_col = end_col;
+            span->next = -1;
+            if (tails[i - line_index] >= 0) {
+                spans[tails[i - line_index]].next = (int)spans_len;
+            } else {
+                heads[i - line_index] = (int)spans_len;
+            }
+            tails[i - line_index] = (int)spans_len;
+            spans_len += 1;
+        }
+    }
+
+    free(tails);
+    *ret_spans = spans;
+    *ret_heads = heads;
+    return MLBUF_OK;
+}
+
 // Set callback to cb. Pass in NULL to unset callback.
 int buffer_set_callback(buffer_t *self, buffer_callback_t cb, void *udata) {
     if (cb) {
@@ -854,6 +1072,47 @@ int buffer_set_callback(buffer_t *self, buffer_callback_t cb, void *udata) {
     return MLBUF_OK;
 }
 
+// Set max memory held by undo actions, dropping the oldest past it. Pass in
+// 0 for no limit.
+int buffer_set_undo_max_bytes(buffer_t *self, bint_t undo_max_bytes) {
+    MLBUF_MAKE_GT_EQ0(undo_max_bytes);
+    self->undo_max_bytes = undo_max_bytes;
+    _buffer_cap_undo_stack(self);
+    return MLBUF_OK;
+}
+
+// Enable/disable folding adjacent inserts or deletes of the same action group
+// into one action. Only enable this if undo is done by action group.
+int buffer_set_undo_coalesced(buffer_t *self, int is_coalesced) {
+    self->is_undo_coalesced = is_coalesced ? 1 : 0;
+    return MLBUF_OK;
+}
+
+// Move payloads of new undo actions of at least min_bytes to an append-only
+// journal file at opt_path, or an unlinked temp file if opt_path is NULL. Only
+// action metadata then stays in memory. Pass in min_bytes 0 to stop.
+int buffer_set_undo_journal(buffer_t *self, char *opt_path, bint_t min_bytes) {
+    char tmppath[16];
+    int fd;
+    _buffer_close_undo_journal(self);
+    if (min_bytes <= 0) return MLBUF_OK;
+    if (opt_path) {
+        fd = open(opt_path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    } else {
+        sprintf(tmppath, "%s", "/tmp/mle-XXXXXX");
+        fd = mkstemp(tmppath);
+        if (fd >= 0) unlink(tmppath);
+    }
+    if (fd < 0) {
+        self->last_errno = errno;
+        return MLBUF_ERR;
+    }
+    self->undo_journal_fd = fd;
+    self->undo_journal_len = 0;
+    self->undo_journal_min_bytes = min_bytes;
+    return MLBUF_OK;
+}
+
 // Set tab_width and recalculate all line char vwidths
 int buffer_set_tab_width(buffer_t *self, int tab_width) {
     bline_t *tmp_line;
@@ -916,7 +1175,8 @@ int buffer_substr(buffer_t *self, bline_t *start_line, bint_t start_col, bline_t
         // Copy add_len bytes from copy_index into data
         if (add_len > 0) {
             if (data_len + add_len + 1 > data_size) {
-                data_size = data_len + add_len + 1; // Plus 1 for nullchar
+                // Grow geometrically so copying many lines is not quadratic
+                data_size = MLBUF_MAX(data_size * 2, data_len + add_len + 1); // Plus 1 for nullchar
                 data = realloc(data, data_size);
             }
             if (copy_len > 0) {
@@ -958,6 +1218,56 @@ int buffer_redo_action_group(buffer_t *self) {
     return _buffer_redo(self, 1);
 }
 
+// Swap the undone actions at the current point in history with the oldest
+// undo tree branch that starts here. Subsequent redos follow that branch.
+int buffer_switch_undo_branch(buffer_t *self) {
+    baction_branch_t *branch;
+    branch = *_buffer_get_branches_at(self, _buffer_get_applied_action(self));
+    if (!branch) return MLBUF_ERR;
+    _buffer_switch_to_branch(self, branch);
+    return MLBUF_OK;
+}
+
+// Go back to the state before the last applied action was recorded, even if
+// that state is on another undo tree branch (like vim's g-)
+int buffer_undo_earlier(buffer_t *self, int by_group) {
+    return _buffer_undo_by_time(self, 0, by_group);
+}
+
+// Go forward to the state after the next recorded action, even if that
+// action is on another undo tree branch (like vim's g+)
+int buffer_undo_later(buffer_t *self, int by_group) {
+    return _buffer_undo_by_time(self, 1, by_group);
+}
+
+// Defer line renumbering until the matching buffer_commit_transaction. Edits
+// made from the end of the buffer backwards, e.g., one per cursor, then avoid
+// renumbering every following line each time. Transactions nest.
+//
+// Styling and the callback are not deferred. Each action only restyles the
+// lines it touched, while a batched restyle would span every line between the
+// topmost and bottommost edit. The callback sees each action so observers do
+// not miss edits, then gets a NULL action on commit to refresh bviews.
+int buffer_begin_transaction(buffer_t *self) {
+    self->transaction_depth += 1;
+    return MLBUF_OK;
+}
+
+// Renumber lines and raise the callback with a NULL action to signal the end
+// of the transaction
+int buffer_commit_transaction(buffer_t *self) {
+    if (self->transaction_depth < 1) return MLBUF_ERR;
+    self->transaction_depth -= 1;
+    if (self->transaction_depth > 0) return MLBUF_OK;
+    if (self->transaction_line) _buffer_renumber_lines(self, self->transaction_line);
+    if (self->callback && !self->is_in_callback) {
+        self->is_in_callback = 1;
+        self->callback(self, NULL, self->callback_udata);
+        self->is_in_callback = 0;
+    }
+    return MLBUF_OK;
+}
+
 
 // Toggle is_style_disabled
 int buffer_set_styles_enabled(buffer_t *self, int is_enabled) {
@@ -1062,6 +1372,10 @@ int bline_count_chars(bline_t *bline) {
     // Unmark dirty
     if (bline->is_chars_dirty) bline->is_chars_dirty = 0;
 
+    // Bump version
+    bline->version = ++bline_version;
+    bline->buffer->version = bline->version;
+
     // Return early if there is no data
     if (bline->data_len < 1) {
         bline->char_count = 0;
@@ -1150,7 +1464,6 @@ int bline_replace(bline_t *self, bint_t col, bint_t num_chars, char *data, bint_
 
 // Return a col given a byte index
 int bline_get_col(bline_t *self, bint_t index, bint_t *ret_col) {
-    bint_t col;
     MLBUF_MAKE_GT_EQ0(index);
     MLBUF_BLINE_ENSURE_CHARS(self);
     if (index == 0 || self->char_count == 0) {
@@ -1160,30 +1473,27 @@ int bline_get_col(bline_t *self, bint_t index, bint_t *ret_col) {
         *ret_col = self->char_count;
         return MLBUF_OK;
     }
-    for (col = 1; col < self->char_count; col++) {
-        if (self->chars[col].index > index) {
-            *ret_col = col - 1;
-            return MLBUF_OK;
-        } else if (self->chars[col].index == index) {
-            *ret_col = col;
-            return MLBUF_OK;
-        }
-    }
-    *ret_col = self->char_count - (index < self->data_len ? 1 : 0);
+    // Despite the name, index_to_vcol holds the col of the char at index
+    *ret_col = self->chars[index].index_to_vcol;
     return MLBUF_OK;
 }
 
 // Convert a vcol to a col
 int bline_get_col_from_vcol(bline_t *bline, bint_t vcol, bint_t *ret_col) {
-    bint_t i;
+    bint_t lo, hi, i;
     MLBUF_BLINE_ENSURE_CHARS(bline);
-    for (i = 0; i < bline->char_count; i++) {
-        if (vcol <= bline->chars[i].vcol) {
-            *ret_col = i;
-            return MLBUF_OK;
+    // Binary search as vcols never decrease along a line
+    lo = 0;
+    hi = bline->char_count;
+    while (lo < hi) {
+        i = lo + (hi - lo) / 2;
+        if (bline->chars[i].vcol < vcol) {
+            lo = i + 1;
+        } else {
+            hi = i;
         }
     }
-    *ret_col = bline->char_count;
+    *ret_col = lo;
     return MLBUF_OK;
 }
 
@@ -1289,26 +1599,44 @@ static void _buffer_stat(buffer_t *self) {
 
 static int _buffer_baction_do(buffer_t *self, bline_t *bline, baction_t *action, int is_redo, bint_t *opt_repeat_offset) {
     int rc;
+    int is_journaled;
     bint_t col;
-    bint_t offset;
+    is_journaled = action->is_journaled;
+    if (is_journaled && _buffer_unjournal_baction(self, action) != MLBUF_OK) {
+        return MLBUF_ERR;
+    }
     self->is_in_undo = 1;
     col = opt_repeat_offset ? *opt_repeat_offset : action->start_col;
-    buffer_get_offset(self, bline, col, &offset);
-    if ((action->type == MLBUF_BACTION_TYPE_DELETE && is_redo)
+    if (action->type == MLBUF_BACTION_TYPE_REPLACE) {
+        rc = buffer_delete_w_bline(self, bline, col, is_redo ? action->del_nchars : action->del_nchars + action->char_delta);
+        if (rc == MLBUF_OK) {
+            rc = is_redo
+                ? buffer_insert_w_bline(self, bline, col, action->data, action->data_len, NULL)
+                : buffer_insert_w_bline(self, bline, col, action->del_data, action->del_data_len, NULL);
+        }
+    } else if ((action->type == MLBUF_BACTION_TYPE_DELETE && is_redo)
         || (action->type == MLBUF_BACTION_TYPE_INSERT && !is_redo)
     ) {
-        rc = buffer_delete(self, offset, (bint_t)((is_redo ? -1 : 1) * action->char_delta));
+        rc = buffer_delete_w_bline(self, bline, col, (bint_t)((is_redo ? -1 : 1) * action->char_delta));
     } else {
-        rc = buffer_insert(self, offset, action->data, action->data_len, NULL);
+        rc = buffer_insert_w_bline(self, bline, col, action->data, action->data_len, NULL);
     }
     self->is_in_undo = 0;
+    if (is_journaled) {
+        // Payload is still in the journal so drop the copy
+        free(action->data);
+        if (action->del_data) free(action->del_data);
+        action->data = NULL;
+        action->del_data = NULL;
+        action->is_journaled = 1;
+    }
     return rc;
 }
 
 static int _buffer_update(buffer_t *self, baction_t *action) {
     bline_t *tmp_line;
-    bline_t *last_line;
     bint_t new_line_index;
+    bint_t i;
 
     // Adjust counts
     self->byte_count += action->byte_delta;
@@ -1319,18 +1647,26 @@ static int _buffer_update(buffer_t *self, baction_t *action) {
     self->is_unsaved = 1;
 
     // Renumber lines
-    if (action->line_delta != 0) {
-        last_line = NULL;
+    if (action->line_delta != 0 && self->transaction_depth > 0) {
+        // Only number lines this action added. The rest wait for commit.
         new_line_index = action->start_line->line_index;
-        for (tmp_line = action->start_line->next; tmp_line != NULL; tmp_line = tmp_line->next) {
+        tmp_line = action->start_line;
+        for (i = 0; i < action->line_delta && tmp_line->next; i++) {
+            tmp_line = tmp_line->next;
             tmp_line->line_index = ++new_line_index;
-            last_line = tmp_line;
         }
-        self->last_line = last_line ? last_line : action->start_line;
+        if (!tmp_line->next) self->last_line = tmp_line;
+        if (!self->transaction_line) self->transaction_line = action->start_line;
+    } else if (action->line_delta != 0) {
+        _buffer_renumber_lines(self, action->start_line);
     }
 
     // Restyle from start_line
-    buffer_apply_styles(self, action->start_line, action->line_delta);
+    if (action->type == MLBUF_BACTION_TYPE_REPLACE) {
+        buffer_apply_styles(self, action->start_line, action->maybe_end_line_index - action->start_line_index);
+    } else {
+        buffer_apply_styles(self, action->start_line, action->line_delta);
+    }
 
     // Raise event on listener
     if (self->callback && !self->is_in_callback) {
@@ -1349,10 +1685,35 @@ static int _buffer_update(buffer_t *self, baction_t *action) {
     return MLBUF_OK;
 }
 
+// In a transaction, only lines after the topmost edit may be misnumbered. An
+// edit there needs them renumbered first. An edit at or above it does not, and
+// becomes the new topmost edit.
+static void _buffer_prepare_edit(buffer_t *self, bline_t *bline) {
+    if (!self->transaction_line) return;
+    if (bline != self->transaction_line && bline->line_index >= self->transaction_line->line_index) {
+        _buffer_renumber_lines(self, self->transaction_line);
+    } else {
+        self->transaction_line = bline;
+    }
+}
+
+// Renumber lines after bline and find last_line
+static void _buffer_renumber_lines(buffer_t *self, bline_t *bline) {
+    bline_t *tmp_line;
+    bint_t new_line_index;
+    new_line_index = bline->line_index;
+    for (tmp_line = bline; tmp_line->next; tmp_line = tmp_line->next) {
+        tmp_line->next->line_index = ++new_line_index;
+    }
+    self->last_line = tmp_line;
+    self->transaction_line = NULL;
+}
+
 static int _buffer_undo(buffer_t *self, int by_group) {
     baction_t *action_to_undo;
     baction_t *first_action;
     bline_t *bline;
+    bline_t *hint;
     int group_to_undo;
 
     // Find action to undo
@@ -1373,10 +1734,12 @@ static int _buffer_undo(buffer_t *self, int by_group) {
     // Remember action group for coarse undo (by_group)
     group_to_undo = action_to_undo->action_group;
 
+    hint = NULL;
     while (1) {
-        // Get line to perform undo on
+        // Get line to perform undo on, starting from the previous action's
+        // line as actions in a group tend to be close together
         bline = NULL;
-        buffer_get_bline(self, action_to_undo->start_line_index, &bline);
+        buffer_get_bline_w_hint(self, action_to_undo->start_line_index, hint, &bline);
         MLBUF_BLINE_ENSURE_CHARS(bline);
         if (!bline) {
             return MLBUF_ERR;
@@ -1389,6 +1752,7 @@ static int _buffer_undo(buffer_t *self, int by_group) {
             return MLBUF_ERR;
         }
         self->action_undone = action_to_undo;
+        hint = bline;
 
         // If by_group, undo next action in same group or break
         if (by_group
@@ -1408,6 +1772,7 @@ static int _buffer_undo(buffer_t *self, int by_group) {
 static int _buffer_redo(buffer_t *self, int by_group) {
     baction_t *action_to_redo;
     bline_t *bline;
+    bline_t *hint;
     int *group_to_redo;
 
     // Find action to undo
@@ -1419,10 +1784,11 @@ static int _buffer_redo(buffer_t *self, int by_group) {
     // Set action group
     group_to_redo = by_group ? &action_to_redo->action_group : NULL;
 
+    hint = NULL;
     while (1) {
-        // Get line to perform undo on
+        // Get line to perform redo on, starting from the previous action's line
         bline = NULL;
-        buffer_get_bline(self, action_to_redo->start_line_index, &bline);
+        buffer_get_bline_w_hint(self, action_to_redo->start_line_index, hint, &bline);
         if (!bline) {
             return MLBUF_ERR;
         }
@@ -1437,6 +1803,7 @@ static int _buffer_redo(buffer_t *self, int by_group) {
             return MLBUF_ERR;
         }
         self->action_undone = action_to_redo->next;
+        hint = bline;
 
         // Redo next action in same group or break
         if (group_to_redo
@@ -1453,47 +1820,294 @@ static int _buffer_redo(buffer_t *self, int by_group) {
     return MLBUF_OK;
 }
 
+static int _buffer_undo_by_time(buffer_t *self, int is_later, int by_group) {
+    baction_t *applied;
+    baction_t *target;
+    applied = _buffer_get_applied_action(self);
+    if (is_later) {
+        target = applied ? applied->time_next : self->actions_by_time;
+        if (!target) return MLBUF_ERR;
+        while (by_group && target->time_next && target->time_next->action_group == target->action_group) {
+            target = target->time_next;
+        }
+    } else {
+        if (!applied) return MLBUF_ERR;
+        target = applied;
+        while (by_group && target != self->actions_by_time && target->time_prev->action_group == applied->action_group) {
+            target = target->time_prev;
+        }
+        target = target != self->actions_by_time ? target->time_prev : NULL;
+    }
+    return _buffer_undo_to(self, target);
+}
+
+// Undo and redo to the state after target, or to the start of history if
+// target is NULL. Branches on the way are switched in, so only the actions
+// between the two states are applied.
+static int _buffer_undo_to(buffer_t *self, baction_t *target) {
+    baction_branch_t *branch;
+    baction_t *action;
+    baction_t *stop;
+    while (1) {
+        // Find the outermost branch on the path to target
+        branch = NULL;
+        for (action = target; action; action = branch->parent) {
+            while (action->prev->next) action = action->prev;
+            if (action == self->actions) break;
+            branch = action->branch;
+        }
+
+        // Move along the current history to where that branch starts, or to
+        // target. Sequence numbers grow along any path in the tree.
+        stop = branch ? branch->parent : target;
+        while ((action = _buffer_get_applied_action(self)) != stop) {
+            if (!stop || (action && action->seq > stop->seq)) {
+                if (_buffer_undo(self, 0) != MLBUF_OK) return MLBUF_ERR;
+            } else if (_buffer_redo(self, 0) != MLBUF_OK) {
+                return MLBUF_ERR;
+            }
+        }
+        if (!branch) break;
+        _buffer_switch_to_branch(self, branch);
+    }
+    return MLBUF_OK;
+}
+
+// Return the last applied action, or NULL if at start of history
+static baction_t *_buffer_get_applied_action(buffer_t *self) {
+    if (self->action_undone) {
+        return self->action_undone != self->actions ? self->action_undone->prev : NULL;
+    }
+    return self->action_tail;
+}
+
 static int _buffer_truncate_undo_stack(buffer_t *self, baction_t *action_from) {
     baction_t *action_target;
     baction_t *action_tmp;
     int do_delete;
-    self->action_tail = action_from->prev != action_from ? action_from->prev : NULL;
+    int is_all;
+    is_all = action_from == self->actions ? 1 : 0;
+    self->action_tail = !is_all ? action_from->prev : NULL;
     do_delete = 0;
     DL_FOREACH_SAFE(self->actions, action_target, action_tmp) {
         if (!do_delete && action_target == action_from) {
             do_delete = 1;
         }
         if (do_delete) {
+            _buffer_free_undo_branches_at(self, action_target);
             DL_DELETE(self->actions, action_target);
-            _baction_destroy(action_target);
+            _buffer_free_baction(self, action_target);
         }
     }
+    if (is_all) _buffer_free_undo_branches_at(self, NULL);
+    if (!self->actions && !self->undo_branches && self->undo_journal_fd >= 0 && ftruncate(self->undo_journal_fd, 0) == 0) {
+        // Nothing refers to the journal anymore
+        self->undo_journal_len = 0;
+    }
     return MLBUF_OK;
 }
 
 static int _buffer_add_to_undo_stack(buffer_t *self, baction_t *action) {
     if (self->action_undone) {
         // We are recording an action after an undo has been performed, so we
-        // need to chop off the tail of the baction list before recording the
-        // new one.
-        // TODO could implement multilevel undo here instead
-        _buffer_truncate_undo_stack(self, self->action_undone);
-        self->action_undone = NULL;
+        // set aside the tail of the baction list as an undo tree branch
+        // before recording the new one.
+        _buffer_branch_undo_stack(self);
+    }
+
+    // Fold into previous action if possible
+    if (self->action_group) action->action_group = *self->action_group;
+    if (_buffer_coalesce_baction(self, action) == MLBUF_OK) {
+        return MLBUF_OK;
     }
 
     // Append action to list
     DL_APPEND(self->actions, action);
-    if (self->action_group) action->action_group = *self->action_group;
+    DL_APPEND2(self->actions_by_time, action, time_prev, time_next);
+    action->seq = ++self->action_seq;
     self->action_tail = action;
+    _buffer_journal_baction(self, action);
+    self->undo_bytes += _baction_get_size(action);
+    _buffer_cap_undo_stack(self);
     return MLBUF_OK;
 }
 
+// Merge action into action_tail and free it if both are single-line inserts
+// or deletes that pick up where the other left off within the same action
+// group. Typing or backspacing a run of chars then takes one action.
+static int _buffer_coalesce_baction(buffer_t *self, baction_t *action) {
+    baction_t *tail;
+    char *data;
+    int is_append;
+
+    tail = self->action_tail;
+    if (!self->is_undo_coalesced
+        || !self->action_group
+        || !tail
+        || tail->is_journaled
+        || tail->branches
+        || tail->type != action->type
+        || tail->action_group != action->action_group
+        || tail->start_line_index != action->start_line_index
+        || tail->line_delta != 0
+        || action->line_delta != 0
+    ) {
+        return MLBUF_ERR;
+    }
+    if (action->type == MLBUF_BACTION_TYPE_INSERT && action->start_col == tail->start_col + tail->char_delta) {
+        is_append = 1; // Typing forward
+    } else if (action->type == MLBUF_BACTION_TYPE_DELETE && action->start_col == tail->start_col) {
+        is_append = 1; // Deleting forward
+    } else if (action->type == MLBUF_BACTION_TYPE_DELETE && action->start_col - action->char_delta == tail->start_col) {
+        is_append = 0; // Backspacing
+    } else {
+        return MLBUF_ERR;
+    }
+
+    data = malloc(tail->data_len + action->data_len);
+    if (is_append) {
+        memcpy(data, tail->data, tail->data_len);
+        memcpy(data + tail->data_len, action->data, action->data_len);
+    } else {
+        memcpy(data, action->data, action->data_len);
+        memcpy(data + action->data_len, tail->data, tail->data_len);
+        tail->start_col = action->start_col;
+    }
+    free(tail->data);
+    tail->data = data;
+    tail->data_len += action->data_len;
+    tail->byte_delta += action->byte_delta;
+    tail->char_delta += action->char_delta;
+    if (action->type == MLBUF_BACTION_TYPE_INSERT) tail->maybe_end_col = action->maybe_end_col;
+    self->undo_bytes += action->data_len;
+
+    // The folded action now ends the later state
+    DL_DELETE2(self->actions_by_time, tail, time_prev, time_next);
+    DL_APPEND2(self->actions_by_time, tail, time_prev, time_next);
+    tail->seq = ++self->action_seq;
+    _baction_destroy(action);
+    _buffer_cap_undo_stack(self);
+    return MLBUF_OK;
+}
+
+// Drop oldest branches then actions while over undo_max_bytes, always keeping
+// the newest action
+static void _buffer_cap_undo_stack(buffer_t *self) {
+    baction_t *action;
+    if (self->undo_max_bytes <= 0) return;
+    while (self->undo_bytes > self->undo_max_bytes && self->undo_branches) {
+        // Drop undo tree branches before any of the current history
+        _buffer_free_undo_branch(self, self->undo_branches);
+    }
+    while (self->undo_bytes > self->undo_max_bytes
+        && self->actions
+        && self->actions != self->action_tail
+        && self->actions != self->action_undone
+    ) {
+        action = self->actions;
+        DL_DELETE(self->actions, action);
+        _buffer_free_baction(self, action);
+    }
+}
+
+// Move undone actions from the end of the history to a new undo tree branch.
+// This is O(1) as the actions stay linked to each other.
+static void _buffer_branch_undo_stack(buffer_t *self) {
+    baction_branch_t *branch;
+    baction_branch_t **branches;
+    baction_t *tail;
+    branch = calloc(1, sizeof(baction_branch_t));
+    tail = self->actions->prev;
+    branch->actions = self->action_undone;
+    if (self->action_undone != self->actions) {
+        branch->parent = self->action_undone->prev;
+        branch->parent->next = NULL;
+        self->actions->prev = branch->parent;
+    } else {
+        self->actions = NULL;
+    }
+    branch->actions->prev = tail;
+    branch->actions->branch = branch;
+    branches = _buffer_get_branches_at(self, branch->parent);
+    DL_APPEND2(*branches, branch, sibling_prev, sibling_next);
+    DL_APPEND(self->undo_branches, branch);
+    self->action_tail = branch->parent;
+    self->action_undone = NULL;
+}
+
+// Swap the undone actions with branch, which must follow the last applied
+// action. This is O(1) as only the ends of the lists are relinked.
+static void _buffer_switch_to_branch(buffer_t *self, baction_branch_t *branch) {
+    baction_t *parent;
+    baction_t *tail;
+    parent = branch->parent;
+    _buffer_unlink_undo_branch(self, branch);
+
+    // Set aside current undone actions as the newest branch
+    if (self->action_undone) _buffer_branch_undo_stack(self);
+
+    // Attach branch in their place
+    tail = branch->actions->prev;
+    if (parent) {
+        parent->next = branch->actions;
+        branch->actions->prev = parent;
+        self->actions->prev = tail;
+    } else {
+        self->actions = branch->actions;
+    }
+    branch->actions->branch = NULL;
+    self->action_tail = tail;
+    self->action_undone = branch->actions;
+    free(branch);
+}
+
+// Return the list of undo tree branches that follow parent
+static baction_branch_t **_buffer_get_branches_at(buffer_t *self, baction_t *parent) {
+    return parent ? &parent->branches : &self->root_branches;
+}
+
+// Remove branch from the undo tree without freeing it
+static void _buffer_unlink_undo_branch(buffer_t *self, baction_branch_t *branch) {
+    baction_branch_t **branches;
+    branches = _buffer_get_branches_at(self, branch->parent);
+    DL_DELETE2(*branches, branch, sibling_prev, sibling_next);
+    DL_DELETE(self->undo_branches, branch);
+}
+
+// Free an undo tree branch and any branches that follow its actions. Each
+// action's own branch list is used, so no other branch is visited.
+static void _buffer_free_undo_branch(buffer_t *self, baction_branch_t *branch) {
+    baction_t *action;
+    baction_t *action_tmp;
+    _buffer_unlink_undo_branch(self, branch);
+    DL_FOREACH_SAFE(branch->actions, action, action_tmp) {
+        _buffer_free_undo_branches_at(self, action);
+        _buffer_free_baction(self, action);
+    }
+    free(branch);
+}
+
+// Free undo tree branches that follow parent
+static void _buffer_free_undo_branches_at(buffer_t *self, baction_t *parent) {
+    baction_branch_t **branches;
+    branches = _buffer_get_branches_at(self, parent);
+    while (*branches) _buffer_free_undo_branch(self, *branches);
+}
+
+// Free a recorded action, which must already be unlinked from its branch
+static void _buffer_free_baction(buffer_t *self, baction_t *action) {
+    DL_DELETE2(self->actions_by_time, action, time_prev, time_next);
+    self->undo_bytes -= _baction_get_size(action);
+    _baction_destroy(action);
+}
+
 static int _buffer_apply_styles_all(bline_t *bline, bint_t min_nlines) {
     buffer_t *buffer;
     srule_node_t *srule_node;
     srule_t *open_rule, *found_rule, *eol_rule_orig;
-    bint_t col, styled_nlines, start, stop;
+    bint_t col, styled_nlines, start, stop, i;
     int eol_rule_changed;
+    int is_open;
 
     buffer = bline->buffer;
     open_rule = bline->prev ? bline->prev->eol_rule : NULL;
@@ -1504,6 +2118,7 @@ static int _buffer_apply_styles_all(bline_t *bline, bint_t min_nlines) {
 
     while (1) {
         found_rule = NULL;
+        is_open = 0;
 
         // Reset style cache at beginning of each line
         if (col == 0) {
@@ -1517,6 +2132,7 @@ static int _buffer_apply_styles_all(bline_t *bline, bint_t min_nlines) {
             // Nothing to do on empty line
         } else if (open_rule) {
             // Look for end of open_rule
+            is_open = 1;
             if (_buffer_match_srule(bline, col, open_rule, 1, &start, &stop)) {
                 // End of open_rule found; close rule
                 found_rule = open_rule;
@@ -1541,6 +2157,12 @@ static int _buffer_apply_styles_all(bline_t *bline, bint_t min_nlines) {
         if (found_rule) {
             // Set style of found_rule
             _buffer_bline_style(bline, MLBUF_MIN(start, col), stop, &found_rule->style);
+
+            // Note chars inside the match, such as brackets in a string or
+            // comment, so bracket matching can skip them
+            for (i = is_open ? MLBUF_MIN(start, col) : start + 1; i < stop && i < bline->char_count; i++) {
+                bline->chars[i].is_in_srule = 1;
+            }
             col = MLBUF_MAX(stop, col + 1);
         } else {
             // Nothing found; advance one char
@@ -1615,7 +2237,12 @@ static int _buffer_match_srule(bline_t *bline, bint_t look_offset, srule_t *srul
 
 static void _buffer_bline_reset_styles(bline_t *bline) {
     sblock_t reset = {0};
+    bint_t i;
     _buffer_bline_style(bline, 0, bline->char_count, &reset);
+    for (i = 0; i < bline->char_count; i++) {
+        bline->chars[i].is_in_srule = 0;
+    }
+    bline->style_version = ++bline_version;
 }
 
 static void _buffer_bline_style(bline_t *bline, bint_t start, bint_t stop, sblock_t *style) {
@@ -1627,18 +2254,22 @@ static void _buffer_bline_style(bline_t *bline, bint_t start, bint_t stop, sbloc
 
 static bline_t *_buffer_bline_new(buffer_t *self) {
     bline_t *bline;
-    bline = calloc(1, sizeof(bline_t));
+    bline = pool_alloc(&self->bline_pool);
     bline->buffer = self;
+    bline->version = ++bline_version;
+    self->version = bline->version;
     return bline;
 }
 
 static int _buffer_bline_free(bline_t *bline, bline_t *maybe_mark_line, bint_t col_delta) {
     mark_t *mark;
     mark_t *mark_tmp;
+    bline->buffer->version = ++bline_version;
     if (!bline->is_data_slabbed) {
         if (bline->data) free(bline->data);
         if (bline->chars) free(bline->chars);
     }
+    if (bline->brackets) free(bline->brackets);
     if (bline->marks) {
         DL_FOREACH_SAFE(bline->marks, mark, mark_tmp) {
             if (maybe_mark_line) {
@@ -1649,7 +2280,7 @@ static int _buffer_bline_free(bline_t *bline, bline_t *maybe_mark_line, bint_t c
         }
     }
     if (!bline->is_slabbed) {
-        free(bline);
+        pool_free(&bline->buffer->bline_pool, bline);
     }
     return MLBUF_OK;
 }
@@ -1692,11 +2323,16 @@ static bline_t *_buffer_bline_break(bline_t *bline, bint_t col) {
     new_line->prev = bline;
     if (tmp_line) tmp_line->prev = new_line;
 
-    // Move marks at or past col to new_line
-    DL_FOREACH_SAFE(bline->marks, mark, mark_tmp) {
-        if (mark_is_after_col_minus_lefties(mark, col)) {
-            _mark_mark_move_inner(mark, new_line, mark->col - col, 1);
-        }
+    // Move marks at or past col to new_line. Marks are sorted by col, so only
+    // the tail of the list is visited.
+    for (mark = bline->marks ? bline->marks->prev : NULL; mark && mark->col >= col; mark = mark_tmp) {
+        mark_tmp = mark != bline->marks ? mark->prev : NULL;
+        if (!mark_is_after_col_minus_lefties(mark, col)) continue;
+        DL_DELETE(bline->marks, mark);
+        mark->bline = new_line;
+        mark->col -= col;
+        mark->target_col = mark->col;
+        DL_PREPEND(new_line->marks, mark);
     }
 
     return new_line;
@@ -1763,17 +2399,142 @@ static void _buffer_bline_replace(bline_t *bline, bint_t start_col, char *data,
     bline_count_chars(bline);
 
     // Fix marks
+    for (mark = bline->marks ? bline->marks->prev : NULL; mark && mark->col > bline->char_count; ) {
+        mark->col = bline->char_count;
+        mark = mark != bline->marks ? mark->prev : NULL;
+    }
+}
+
+// Match cre against bline from look_offset, stopping at matches that start at
+// or after stop_offset. Write the replaced line to ret_data and the byte bounds
+// of each match (old start, old end, new start, new end) to offsets. Return
+// the number of replacements.
+static bint_t _buffer_bline_match_all(bline_t *bline, bint_t look_offset, bint_t stop_offset, pcre2_code *cre, char *repl, str_t *ret_data, bint_t **offsets, bint_t *offsets_cap) {
+    int rc;
+    char *subj;
+    bint_t subj_len;
+    bint_t copy_offset;
+    bint_t num_matches;
+    bint_t *match_offsets;
+    int ovector_count;
+    uint32_t ch;
+    PCRE2_SIZE ovector[30];
+
+    subj = bline->data ? bline->data : "";
+    subj_len = bline->data_len;
+    copy_offset = 0;
+    num_matches = 0;
+    str_clear(ret_data);
+
+    while (look_offset <= subj_len && look_offset < stop_offset) {
+        rc = pcre2_match(cre, (PCRE2_SPTR)subj, (PCRE2_SIZE)subj_len, (PCRE2_SIZE)look_offset, 0, pcre2_md, NULL);
+        if (rc < 0) break;
+        ovector_count = MLBUF_MIN((int)(pcre2_get_ovector_count(pcre2_md) * 2), 30);
+        memcpy(ovector, pcre2_get_ovector_pointer(pcre2_md), ovector_count * sizeof(PCRE2_SIZE));
+        if ((bint_t)ovector[0] >= stop_offset) break;
+
+        // Skip empty matches with empty replacements
+        if (ovector[0] != ovector[1] || *repl != '\0') {
+            if ((num_matches + 1) * 4 > *offsets_cap) {
+                *offsets_cap = MLBUF_MAX(32, *offsets_cap * 2);
+                *offsets = realloc(*offsets, *offsets_cap * sizeof(bint_t));
+            }
+            match_offsets = *offsets + (num_matches * 4);
+            str_append_len(ret_data, subj + copy_offset, ovector[0] - copy_offset);
+            match_offsets[0] = (bint_t)ovector[0];
+            match_offsets[1] = (bint_t)ovector[1];
+            match_offsets[2] = (bint_t)ret_data->len;
+            str_append_replace_with_backrefs(ret_data, subj, repl, rc, ovector, 30);
+            match_offsets[3] = (bint_t)ret_data->len;
+            copy_offset = (bint_t)ovector[1];
+            num_matches += 1;
+        }
+
+        // Step over one char after an empty match
+        if (ovector[1] > ovector[0]) {
+            look_offset = (bint_t)ovector[1];
+        } else if ((bint_t)ovector[1] >= subj_len) {
+            break;
+        } else {
+            look_offset = (bint_t)ovector[1] + MLBUF_MAX(1, utf8_char_to_unicode(&ch, subj + ovector[1], subj + subj_len));
+        }
+    }
+
+    if (num_matches > 0) {
+        str_append_len(ret_data, subj + copy_offset, subj_len - copy_offset);
+    }
+    return num_matches;
+}
+
+// Swap in data produced by _buffer_bline_match_all, remapping marks and
+// breaking the line on any newlines introduced by replacements. Return the
+// last line produced.
+static bline_t *_buffer_bline_apply_all(bline_t *bline, str_t *data, bint_t *offsets, bint_t num_matches, bint_t *ret_num_lines_added) {
+    mark_t *mark;
+    bline_t *new_line;
+    char *newline;
+    bint_t index;
+    bint_t delta;
+    bint_t i;
+    bint_t col;
+    bint_t *match_offsets;
+
+    // Unslab if needed
+    if (bline->is_data_slabbed) _buffer_bline_unslab(bline);
+
+    // Map each mark to a byte index in the new data. A mark within a match
+    // ends up after the replacement, unless it is lefty or sits at the start
+    // of a non-empty match.
     DL_FOREACH(bline->marks, mark) {
-        if (mark->col > bline->char_count) {
-            mark->col = bline->char_count;
+        index = _buffer_bline_col_to_index(bline, mark->col);
+        delta = 0;
+        for (i = 0; i < num_matches; i++) {
+            match_offsets = offsets + (i * 4);
+            if (index < match_offsets[0]) {
+                break;
+            } else if (index == match_offsets[0]) {
+                delta = (mark->lefty || match_offsets[0] != match_offsets[1] ? match_offsets[2] : match_offsets[3]) - index;
+                break;
+            } else if (index <= match_offsets[1]) {
+                delta = match_offsets[3] - index;
+                break;
+            }
+            delta = match_offsets[3] - match_offsets[1];
         }
+        mark->col = index + delta; // Byte index until chars are recounted
+    }
+
+    // Swap in new data
+    if (bline->data) free(bline->data);
+    bline->data = data->data;
+    bline->data_len = (bint_t)data->len;
+    bline->data_cap = (bint_t)data->cap;
+    memset(data, 0, sizeof(str_t));
+    bline_count_chars(bline);
+    DL_FOREACH(bline->marks, mark) {
+        mark->col = _buffer_bline_index_to_col(bline, mark->col);
+        mark->target_col = mark->col;
     }
+    DL_SORT(bline->marks, _buffer_mark_cmp_col); // Marks at one col may have split
+
+    // Break line on newlines
+    *ret_num_lines_added = 0;
+    while (bline->data_len > 0 && (newline = memchr(bline->data, '\n', bline->data_len)) != NULL) {
+        col = _buffer_bline_index_to_col(bline, (bint_t)(newline - bline->data));
+        new_line = _buffer_bline_break(bline, col + 1);
+        _buffer_bline_delete(bline, col, 1);
+        bline = new_line;
+        *ret_num_lines_added += 1;
+    }
+
+    return bline;
 }
 
 static bint_t _buffer_bline_insert(bline_t *bline, bint_t col, char *data, bint_t data_len, int move_marks) {
     bint_t index;
     mark_t *mark;
     mark_t *mark_tmp;
+    mark_t *first_moved;
     bint_t orig_char_count;
     bint_t num_chars_added;
 
@@ -1809,11 +2570,23 @@ static bint_t _buffer_bline_insert(bline_t *bline, bint_t col, char *data, bint_
     bline_count_chars(bline);
     num_chars_added = bline->char_count - orig_char_count;
 
-    // Move marks after col right by num_chars_added
-    if (move_marks) {
-        DL_FOREACH_SAFE(bline->marks, mark, mark_tmp) {
+    // Move marks after col right by num_chars_added. Marks are sorted by col,
+    // so only the tail of the list is visited.
+    if (move_marks && bline->marks && num_chars_added > 0) {
+        first_moved = NULL;
+        for (mark = bline->marks->prev; mark && mark->col >= col; mark = mark_tmp) {
+            mark_tmp = mark != bline->marks ? mark->prev : NULL;
             if (mark_is_after_col_minus_lefties(mark, col)) {
                 mark->col += num_chars_added;
+                first_moved = mark;
+            }
+        }
+        // Lefty marks at col stay put. Relink any that a moved mark passed.
+        for (mark = first_moved; mark && mark->col <= col + num_chars_added; mark = mark_tmp) {
+            mark_tmp = mark->next;
+            if (mark->col == col) {
+                DL_DELETE(bline->marks, mark);
+                DL_PREPEND_ELEM(bline->marks, first_moved, mark);
             }
         }
     }
@@ -1865,11 +2638,11 @@ static bint_t _buffer_bline_delete(bline_t *bline, bint_t col, bint_t num_chars)
     bline_count_chars(bline);
     num_chars_deleted = orig_char_count - bline->char_count;
 
-    // Move marks after col left by num_chars_deleted
-    DL_FOREACH_SAFE(bline->marks, mark, mark_tmp) {
-        if (mark->col > col) {
-            mark->col = MLBUF_MAX(0, mark->col - num_chars_deleted);
-        }
+    // Move marks after col left by num_chars_deleted. Marks within the deleted
+    // range end up at col.
+    for (mark = bline->marks ? bline->marks->prev : NULL; mark && mark->col > col; mark = mark_tmp) {
+        mark_tmp = mark != bline->marks ? mark->prev : NULL;
+        mark->col = MLBUF_MAX(col, mark->col - num_chars_deleted);
     }
 
     return num_chars_deleted;
@@ -1899,6 +2672,71 @@ static bint_t _buffer_bline_index_to_col(bline_t *bline, bint_t index) {
     return bline->chars[index].index_to_vcol;
 }
 
+// Compare marks on one line by col for DL_SORT
+static int _buffer_mark_cmp_col(mark_t *a, mark_t *b) {
+    return a->col < b->col ? -1 : (a->col > b->col ? 1 : 0);
+}
+
+// Drop all lines and undo history in bulk without recording a delete action.
+// Marks move to the start of the single empty line left behind. The listener
+// gets one MLBUF_BACTION_TYPE_RESET action instead of a delete.
+static void _buffer_reset(buffer_t *self) {
+    bline_t *bline;
+    bline_t *bline_tmp;
+    bline_t *new_line;
+    mark_t *mark;
+    mark_t *mark_tmp;
+    baction_t action = {0};
+
+    action.byte_delta = -self->byte_count;
+    action.line_delta = 1 - self->line_count;
+    new_line = _buffer_bline_new(self);
+    for (bline = self->first_line; bline; bline = bline_tmp) {
+        bline_tmp = bline->next;
+        DL_FOREACH_SAFE(bline->marks, mark, mark_tmp) {
+            DL_DELETE(bline->marks, mark);
+            mark->bline = new_line;
+            mark->col = 0;
+            mark->target_col = 0;
+            DL_APPEND(new_line->marks, mark);
+        }
+        if (!bline->is_data_slabbed) {
+            if (bline->data) free(bline->data);
+            if (bline->chars) free(bline->chars);
+        }
+        if (bline->brackets) free(bline->brackets);
+        if (!bline->is_slabbed) pool_free(&self->bline_pool, bline);
+    }
+    if (self->slabbed_blines) free(self->slabbed_blines);
+    if (self->slabbed_chars) free(self->slabbed_chars);
+    self->slabbed_blines = NULL;
+    self->slabbed_chars = NULL;
+    _buffer_munmap(self);
+
+    self->first_line = new_line;
+    self->last_line = new_line;
+    self->line_count = 1;
+    self->byte_count = 0;
+    self->is_data_dirty = 1;
+    self->is_unsaved = 1;
+
+    while (self->undo_branches) _buffer_free_undo_branch(self, self->undo_branches);
+    if (self->actions) _buffer_truncate_undo_stack(self, self->actions);
+    self->action_undone = NULL;
+
+    // Raise event on listener. The action is not recorded for undo.
+    if (self->callback && !self->is_in_callback) {
+        action.type = MLBUF_BACTION_TYPE_RESET;
+        action.buffer = self;
+        action.start_line = new_line;
+        action.maybe_end_line = new_line;
+        action.data = "";
+        self->is_in_callback = 1;
+        self->callback(self, &action, self->callback_udata);
+        self->is_in_callback = 0;
+    }
+}
+
 // Close self->fd and self->mmap if needed
 static int _buffer_munmap(buffer_t *self) {
     if (self->mmap) {
@@ -1976,9 +2814,82 @@ int srule_destroy(srule_t *srule) {
     return MLBUF_OK;
 }
 
+// Return memory held by action
+static bint_t _baction_get_size(baction_t *action) {
+    if (action->is_journaled) return (bint_t)sizeof(baction_t);
+    return (bint_t)sizeof(baction_t) + action->data_len + action->del_data_len;
+}
+
+// Move payload of action to the undo journal if it is big enough
+static void _buffer_journal_baction(buffer_t *self, baction_t *action) {
+    bint_t offset;
+    if (self->undo_journal_fd < 0
+        || action->is_journaled
+        || action->data_len + action->del_data_len < self->undo_journal_min_bytes
+    ) {
+        return;
+    }
+    offset = self->undo_journal_len;
+    if (pwrite(self->undo_journal_fd, action->data, action->data_len, offset) != action->data_len
+        || (action->del_data_len > 0 && pwrite(self->undo_journal_fd, action->del_data, action->del_data_len, offset + action->data_len) != action->del_data_len)
+    ) {
+        // Keep payload in memory
+        return;
+    }
+    self->undo_journal_len += action->data_len + action->del_data_len;
+    free(action->data);
+    if (action->del_data) free(action->del_data);
+    action->data = NULL;
+    action->del_data = NULL;
+    action->journal_offset = offset;
+    action->is_journaled = 1;
+}
+
+// Read payload of action back from the undo journal
+static int _buffer_unjournal_baction(buffer_t *self, baction_t *action) {
+    char *data;
+    char *del_data;
+    data = malloc(action->data_len);
+    del_data = action->del_data_len > 0 ? malloc(action->del_data_len) : NULL;
+    if (pread(self->undo_journal_fd, data, action->data_len, action->journal_offset) != action->data_len
+        || (del_data && pread(self->undo_journal_fd, del_data, action->del_data_len, action->journal_offset + action->data_len) != action->del_data_len)
+    ) {
+        free(data);
+        if (del_data) free(del_data);
+        return MLBUF_ERR;
+    }
+    action->data = data;
+    action->del_data = del_data;
+    action->is_journaled = 0;
+    return MLBUF_OK;
+}
+
+// Close undo journal, reading spilled payloads back into memory
+static void _buffer_close_undo_journal(buffer_t *self) {
+    baction_t *action;
+    baction_branch_t *branch;
+    if (self->undo_journal_fd < 0) return;
+    DL_FOREACH(self->actions, action) {
+        if (action->is_journaled && _buffer_unjournal_baction(self, action) == MLBUF_OK) {
+            self->undo_bytes += action->data_len + action->del_data_len;
+        }
+    }
+    DL_FOREACH(self->undo_branches, branch) {
+        DL_FOREACH(branch->actions, action) {
+            if (action->is_journaled && _buffer_unjournal_baction(self, action) == MLBUF_OK) {
+                self->undo_bytes += action->data_len + action->del_data_len;
+            }
+        }
+    }
+    close(self->undo_journal_fd);
+    self->undo_journal_fd = -1;
+    self->undo_journal_len = 0;
+}
+
 static int _baction_destroy(baction_t *action) {
     if (action->data) free(action->data);
-    free(action);
+    if (action->del_data) free(action->del_data);
+    pool_free(&action->buffer->baction_pool, action);
     return MLBUF_OK;
 }
 
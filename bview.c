@@ -18,13 +18,46 @@ static void _bview_draw_prompt(bview_t *self);
 static void _bview_draw_status(bview_t *self);
 static void _bview_draw_edit(bview_t *self, int x, int y, int w, int h);
 static void _bview_draw_bline(bview_t *self, bline_t *bline, int rect_y, bline_t **optret_bline, int *optret_rect_y);
+static void _bview_draw_linenum(bview_t *self, bline_t *bline, int rect_y);
+static void _bview_draw_linenum_int(bview_t *self, int x, int rect_y, int width, bint_t n, uint16_t fg);
 static void _bview_highlight_bracket_pair(bview_t *self, mark_t *mark);
+static int _bview_find_bracket_pair(bview_t *self, mark_t *mark, bline_t **ret_bline, bint_t *ret_col);
+static void _bview_clear_bracket_pairs(bview_t *self);
+static uint64_t _bview_get_rows_key(bview_t *self);
+static uint64_t _bview_get_range_key(bview_t *self, bline_t *bline);
+static void _bview_index_range_srules(bview_t *self);
+static int _bview_is_row_unchanged(bview_t *self, int rect_y, bline_t *opt_bline);
+static void _bview_set_row_overlaid(bview_t *self, int screen_y);
+static void _bview_scroll_rows(bview_t *self, bint_t delta);
+static int _bview_is_row_cached(bview_t *self);
+static render_line_t *_bview_get_render_line(bview_t *self, bline_t *bline, bint_t viewport_x, int is_cursor_line, uint64_t range_key);
+static void _bview_keep_render_line(bview_t *self, bline_t *bline);
+static void _bview_clear_render_lines(bview_t *self, int is_stale_only);
 static bint_t _bview_get_viewport_x(bview_t *self, bline_t *bline);
 static int _bview_is_cursor_line(bview_t *self, bline_t *bline);
 static int _bview_is_soft_wrapped(bview_t *self, bline_t *bline);
-static int _bview_is_in_range(bline_t *bline, bint_t col, int is_block, srule_t **ret_srule);
+static int _bview_is_in_range(bview_t *self, bline_t *bline, bint_t col, srule_t **ret_srule);
 static int _bview_is_in_isearch(bview_t *self, bint_t col, srule_t **ret_srule);
-static int _bview_populate_isearch_ranges(bview_t *self, bline_t *bline);
+static int _bview_populate_isearch_ranges(bview_t *self, bline_t *bline, bint_t start_col, bint_t stop_vcol);
+static int _bview_set_match_index(match_index_t *index, char *opt_regex, int regex_len);
+static match_line_t *_bview_get_match_line(match_index_t *index, bline_t *bline);
+static match_line_t *_bview_new_match_line(match_index_t *index, bline_t *bline);
+static void _bview_narrow_match_index(match_index_t *index, char *regex, int regex_len);
+static void _bview_clear_match_index(match_index_t *index);
+static void _bview_reset_match_count(match_index_t *index);
+static void _bview_update_match_count(match_index_t *index, baction_t *action);
+static void _bview_update_sorted_matches(match_index_t *index, baction_t *action);
+static size_t _bview_find_sorted_line(match_index_t *index, bint_t line_index);
+static void _bview_number_sorted_matches(match_index_t *index);
+static bint_t _bview_count_match_starts(match_line_t *line, bint_t max_offset);
+static void _bview_sweep_match_index(match_index_t *index);
+static bint_t _bview_count_matches(match_index_t *index, char *data, bint_t data_len);
+static void _bview_destroy_match_line(match_index_t *index, match_line_t *line);
+static void _bview_free_match_line(match_line_t *line);
+static void _bview_index_match_line(match_line_t *line);
+static int _bview_is_literal_re(char *re, int re_len);
+static int _bview_cmp_cursors(cursor_t *a, cursor_t *b);
+static int _bview_is_cursor_collapsed(cursor_t *a, cursor_t *b);
 
 // Create a new bview
 bview_t *bview_new(editor_t *editor, int type, char *opt_path, int opt_path_len, buffer_t *opt_buffer) {
@@ -50,6 +83,9 @@ bview_t *bview_new(editor_t *editor, int type, char *opt_path, int opt_path_len,
     self->viewport_scope_x = editor->viewport_scope_x;
     self->viewport_scope_y = editor->viewport_scope_y;
     self->id = (id++);
+    self->isearch_index = calloc(1, sizeof(match_index_t));
+    self->search_index = calloc(1, sizeof(match_index_t));
+    self->search_index->is_sorted = 1;
 
     // Open buffer
     if (opt_buffer) {
@@ -77,6 +113,12 @@ int bview_open(bview_t *self, char *path, int path_len) {
 int bview_destroy(bview_t *self) {
     _bview_deinit(self);
     if (self->path) free(self->path);
+    free(self->isearch_index);
+    free(self->search_index);
+    if (self->rows) free(self->rows);
+    _bview_clear_render_lines(self, 0);
+    if (self->range_spans) free(self->range_spans);
+    if (self->range_heads) free(self->range_heads);
     // TODO ensure everything freed
     free(self);
     return MLE_OK;
@@ -86,6 +128,11 @@ int bview_destroy(bview_t *self) {
 int bview_resize(bview_t *self, int x, int y, int w, int h) {
     int aw, ah;
 
+    if (self->x != x || self->y != y || self->w != w || self->h != h) {
+        // Uncovered screen areas need a repaint
+        self->editor->is_display_dirty = 1;
+    }
+
     self->x = x;
     self->y = y;
     self->w = w;
@@ -194,6 +241,7 @@ int bview_draw_cursor(bview_t *self, int set_real_cursor) {
         } else {
             // Set fake cursor
             tb_set_cell(screen_x, screen_y, cell->ch, cell->fg, cell->bg | (cursor->is_asleep ? TB_RED : TB_CYAN)); // TODO configurable
+            _bview_set_row_overlaid(self, screen_y);
         }
         if (self->editor->highlight_bracket_pairs) {
             _bview_highlight_bracket_pair(self, mark);
@@ -314,23 +362,50 @@ int bview_remove_cursors_except(bview_t *self, cursor_t *one) {
 
 // Remove a cursor from a bview
 int bview_remove_cursor(bview_t *self, cursor_t *cursor) {
-    cursor_t *el;
-    cursor_t *tmp;
-    DL_FOREACH_SAFE(self->cursors, el, tmp) {
-        if (el == cursor) {
-            self->active_cursor = el->prev && el->prev != el ? el->prev : el->next;
-            DL_DELETE(self->cursors, el);
-            if (el->sel_rule) {
-                buffer_remove_srule(el->bview->buffer, el->sel_rule);
-                srule_destroy(el->sel_rule);
-                el->sel_rule = NULL;
-            }
-            if (el->cut_buffer) free(el->cut_buffer);
-            free(el);
-            return MLE_OK;
+    if (!cursor || cursor->bview != self) {
+        return MLE_ERR;
+    }
+    if (cursor == self->active_cursor) {
+        self->active_cursor = cursor->prev && cursor->prev != cursor ? cursor->prev : cursor->next;
+    }
+    DL_DELETE(self->cursors, cursor);
+    if (cursor->sel_rule) {
+        buffer_remove_srule(self->buffer, cursor->sel_rule);
+        srule_destroy(cursor->sel_rule);
+        cursor->sel_rule = NULL;
+    }
+    if (cursor->is_anchored) mark_destroy(cursor->anchor);
+    mark_destroy(cursor->mark);
+    if (cursor->cut_buffer) free(cursor->cut_buffer);
+    free(cursor);
+    return MLE_OK;
+}
+
+// Put cursors in document order and remove any that collapsed onto another.
+// Called before and after each command, so multi-cursor commands can rely on
+// order.
+int bview_sort_cursors(bview_t *self) {
+    cursor_t *cursor;
+    cursor_t *cursor_tmp;
+    if (!self->cursors || !self->cursors->next) {
+        return MLE_OK;
+    }
+    DL_SORT(self->cursors, _bview_cmp_cursors);
+    for (cursor = self->cursors; cursor->next; ) {
+        if (!_bview_is_cursor_collapsed(cursor, cursor->next)) {
+            cursor = cursor->next;
+            continue;
+        }
+        // Keep the active cursor
+        if (cursor == self->active_cursor) {
+            bview_remove_cursor(self, cursor->next);
+        } else {
+            cursor_tmp = cursor->next;
+            bview_remove_cursor(self, cursor);
+            cursor = cursor_tmp;
         }
     }
-    return MLE_ERR;
+    return MLE_OK;
 }
 
 // Set viewport y safely
@@ -520,25 +595,47 @@ static void _bview_buffer_callback(buffer_t *buffer, baction_t *action, void *ud
     editor = self->editor;
     active = editor->active;
 
-    // Rectify viewport if edit was on active bview
-    if (active->buffer == buffer) {
-        bview_rectify_viewport(active);
+    bview_t *bview;
+    bview_t *tmp1;
+    bview_t *tmp2;
+
+    if (action && action->type == MLBUF_BACTION_TYPE_RESET) {
+        // All lines were dropped, so drop everything cached about them
+        CDL_FOREACH_SAFE2(editor->all_bviews, bview, tmp1, tmp2, all_prev, all_next) {
+            if (bview->buffer != buffer) continue;
+            _bview_clear_match_index(bview->isearch_index);
+            _bview_clear_match_index(bview->search_index);
+            bview->is_dirty = 1;
+        }
+    } else if (action) {
+        // Recount matches on edited lines
+        CDL_FOREACH_SAFE2(editor->all_bviews, bview, tmp1, tmp2, all_prev, all_next) {
+            if (bview->buffer != buffer) continue;
+            _bview_update_match_count(bview->isearch_index, action);
+            _bview_update_match_count(bview->search_index, action);
+        }
     }
 
-    if (action && action->line_delta != 0) {
-        bview_t *bview;
-        bview_t *tmp1;
-        bview_t *tmp2;
+    // In a transaction, wait for the commit (NULL action) to refresh bviews
+    if (!action || buffer->transaction_depth < 1) {
+        // Rectify viewport if edit was on active bview
+        if (active->buffer == buffer) {
+            bview_rectify_viewport(active);
+        }
+
         CDL_FOREACH_SAFE2(editor->all_bviews, bview, tmp1, tmp2, all_prev, all_next) {
-            if (bview->buffer == buffer) {
-                // Adjust linenum_width
-                if (_bview_set_linenum_width(bview)) {
-                    bview_resize(bview, bview->x, bview->y, bview->w, bview->h);
-                }
+            if (bview->buffer != buffer) continue;
+
+            // Adjust linenum_width
+            if ((!action || action->line_delta != 0) && _bview_set_linenum_width(bview)) {
+                bview_resize(bview, bview->x, bview->y, bview->w, bview->h);
             }
         }
     }
 
+    // Listeners and observers already saw each action of a transaction
+    if (!action) return;
+
     // Call bview listeners
     DL_FOREACH(self->listeners, listener) {
         listener->callback(self, action, listener->udata);
@@ -551,6 +648,7 @@ static void _bview_buffer_callback(buffer_t *buffer, baction_t *action, void *ud
 // Set linenum_width and return 1 if changed
 static int _bview_set_linenum_width(bview_t *self) {
     int orig;
+    int i;
     orig = self->linenum_width;
     self->abs_linenum_width = MLE_MAX(1, (int)(floor(log10((double)self->buffer->line_count))) + 1);
     if (self->editor->linenum_type != MLE_LINENUM_TYPE_ABS) {
@@ -568,6 +666,10 @@ static int _bview_set_linenum_width(bview_t *self) {
     } else if (self->editor->linenum_type == MLE_LINENUM_TYPE_BOTH) {
         self->linenum_width = self->abs_linenum_width + 1 + self->rel_linenum_width;
     }
+    self->linenum_mod = 1;
+    for (i = 0; i < self->linenum_width && self->linenum_mod <= INTMAX_MAX / 10; i++) {
+        self->linenum_mod *= 10;
+    }
     return orig == self->linenum_width ? 0 : 1;
 }
 
@@ -620,11 +722,10 @@ static void _bview_deinit(bview_t *self) {
     // we are re-using a bview, e.g., after cmd_open_replace_file.
     self->viewport_mark = NULL;
 
-    // Free last_search
-    if (self->last_search) {
-        free(self->last_search);
-        self->last_search = NULL;
-    }
+    // Free last_search and match indexes
+    bview_set_search(self, NULL);
+    _bview_set_match_index(self->isearch_index, NULL, 0);
+    _bview_clear_bracket_pairs(self);
 
     // Free isearch_ranges
     if (self->isearch_ranges) {
@@ -635,6 +736,134 @@ static void _bview_deinit(bview_t *self) {
     }
 }
 
+// Set isearch regex
+int bview_set_isearch(bview_t *self, char *opt_regex, int regex_len) {
+    srule_t *rule;
+
+    if (!opt_regex || regex_len < 1) {
+        if (self->isearch_rule) {
+            srule_destroy(self->isearch_rule);
+            self->isearch_rule = NULL;
+        }
+        _bview_set_match_index(self->isearch_index, NULL, 0);
+        self->is_dirty = 1;
+        return MLE_OK;
+    }
+
+    self->is_dirty = 1;
+    rule = srule_new_single(opt_regex, regex_len, 1, TB_BOLD, TB_MAGENTA);
+    if (!rule) {
+        bview_set_isearch(self, NULL, 0);
+        return MLE_ERR;
+    }
+    _bview_set_match_index(self->isearch_index, opt_regex, regex_len);
+
+    if (self->isearch_rule) srule_destroy(self->isearch_rule);
+    self->isearch_rule = rule;
+    return MLE_OK;
+}
+
+// Set last_search regex. Takes ownership of opt_regex.
+int bview_set_search(bview_t *self, char *opt_regex) {
+    if (self->last_search) free(self->last_search);
+    self->last_search = opt_regex;
+    return _bview_set_match_index(self->search_index, opt_regex, opt_regex ? (int)strlen(opt_regex) : 0);
+}
+
+// Count matches in buffer, resuming where the last call left off. Stop after
+// about max_bytes of lines so large buffers can be counted between inputs.
+int bview_match_count(bview_t *self, match_index_t *index, bint_t max_bytes, bint_t *ret_count, int *ret_is_done) {
+    match_line_t *line;
+    bline_t *bline;
+    bint_t nbytes;
+    if (!index->is_counted && index->cre) {
+        bline = index->count_line ? index->count_line : self->buffer->first_line;
+        for (nbytes = 0; bline && nbytes < max_bytes; bline = bline->next) {
+            if (index->is_sorted) {
+                // Append to sorted as lines are counted in buffer order
+                line = _bview_new_match_line(index, bline);
+                if (line) {
+                    line->line_index = bline->line_index;
+                    if (index->sorted_len + 1 > index->sorted_cap) {
+                        index->sorted_cap = 2 * MLE_MAX(index->sorted_cap, 8);
+                        index->sorted = realloc(index->sorted, sizeof(match_line_t*) * index->sorted_cap);
+                    }
+                    index->sorted[index->sorted_len++] = line;
+                    index->count += (bint_t)line->offsets_len / 2;
+                }
+            } else {
+                index->count += _bview_count_matches(index, bline->data, bline->data_len);
+            }
+            nbytes += bline->data_len + 1;
+        }
+        index->count_line = bline;
+        index->is_counted = bline ? 0 : 1;
+    }
+    *ret_count = index->count;
+    *ret_is_done = index->is_counted || !index->cre;
+    return MLE_OK;
+}
+
+// Move mark to the next (or prev) match start in a sorted index, wrapping
+// around. Set optret_nth to the 0-based number of the match. Return MLE_ERR if
+// there are no matches or the index is still being counted.
+int bview_match_move(bview_t *self, match_index_t *index, mark_t *mark, int is_prev, bint_t *optret_nth) {
+    match_line_t *line;
+    bint_t look_offset;
+    bint_t nth;
+    size_t i;
+
+    if (!index->is_sorted || !index->is_counted || index->count < 1) return MLE_ERR;
+    _bview_number_sorted_matches(index);
+
+    // Count match starts before mark, or up to and including mark if moving
+    // forward
+    i = _bview_find_sorted_line(index, mark->bline->line_index);
+    nth = i < index->sorted_len ? index->sorted[i]->nth : index->count;
+    if (i < index->sorted_len && index->sorted[i]->bline == mark->bline) {
+        line = index->sorted[i];
+        MLBUF_BLINE_ENSURE_CHARS(mark->bline);
+        look_offset = mark->col < mark->bline->char_count ? mark->bline->chars[mark->col].index : mark->bline->data_len;
+        nth += _bview_count_match_starts(line, is_prev ? look_offset : look_offset + 1);
+    }
+
+    // Wrap
+    if (is_prev) nth -= 1;
+    if (nth < 0) nth = index->count - 1;
+    if (nth >= index->count) nth = 0;
+
+    if (optret_nth) *optret_nth = nth;
+    return bview_match_move_nth(self, index, mark, nth);
+}
+
+// Move mark to the 0-based nth match start in a sorted index
+int bview_match_move_nth(bview_t *self, match_index_t *index, mark_t *mark, bint_t nth) {
+    match_line_t *line;
+    bint_t col;
+    size_t lo, hi, i;
+    (void)self;
+
+    if (!index->is_sorted || !index->is_counted || nth < 0 || nth >= index->count) return MLE_ERR;
+    _bview_number_sorted_matches(index);
+
+    // Find last line with at most nth match starts before it
+    lo = 0;
+    hi = index->sorted_len;
+    while (lo < hi) {
+        i = (lo + hi) / 2;
+        if (index->sorted[i]->nth <= nth) {
+            lo = i + 1;
+        } else {
+            hi = i;
+        }
+    }
+    line = index->sorted[lo - 1];
+
+    bline_index_to_col(line->bline, line->offsets[2 * (nth - line->nth)], &col);
+    mark_move_to_w_bline(mark, line->bline, col);
+    return MLE_OK;
+}
+
 // Set syntax on bview buffer
 int bview_set_syntax(bview_t *self, char *opt_syntax) {
     syntax_t *syntax;
@@ -692,6 +921,9 @@ int bview_set_syntax(bview_t *self, char *opt_syntax) {
 
     buffer_set_styles_enabled(self->buffer, 1);
 
+    // Bracket pairs skip strings and comments, which may have changed
+    _bview_clear_bracket_pairs(self);
+
     return use_syntax ? MLE_OK : MLE_ERR;
 }
 
@@ -796,7 +1028,12 @@ static buffer_t *_bview_open_buffer(bview_t *self, char *opt_path, int opt_path_
         }
     }
     buffer_set_callback(buffer, _bview_buffer_callback, self);
-    buffer_set_action_group_ptr(buffer, &self->editor->user_input_count);
+    buffer_set_action_group_ptr(buffer, &self->editor->action_group);
+    buffer_set_undo_max_bytes(buffer, (bint_t)self->editor->undo_max_kb * 1024);
+    buffer_set_undo_coalesced(buffer, self->editor->coarse_undo);
+    if (self->editor->undo_journal_kb > 0 && buffer->undo_journal_fd < 0) {
+        buffer_set_undo_journal(buffer, NULL, (bint_t)self->editor->undo_journal_kb * 1024);
+    }
     _bview_set_tab_width(self, self->tab_width);
     return buffer;
 }
@@ -960,6 +1197,9 @@ static void _bview_draw_edit(bview_t *self, int x, int y, int w, int h) {
     int rect_y;
     int fg_attr;
     int bg_attr;
+    int is_row_cached;
+    int row_state;
+    uint64_t rows_key;
     bline_t *bline;
     bint_t viewport_y;
 
@@ -1008,22 +1248,67 @@ static void _bview_draw_edit(bview_t *self, int x, int y, int w, int h) {
             self->buffer, self->buffer->is_unsaved ? '*' : ' ');
     }
 
-    // Render lines and margins
+    // Index selections once rather than per char
+    _bview_index_range_srules(self);
+
+    // Skip rows drawn the same last time. The terminal back buffer still
+    // holds them.
     bline = self->viewport_mark->bline;
     viewport_y = bline->line_index;
+    is_row_cached = _bview_is_row_cached(self);
+    if (is_row_cached) {
+        self->render_epoch += 1;
+        rows_key = _bview_get_rows_key(self);
+        if (self->rows_len != self->rect_buffer.h) {
+            self->rows = realloc(self->rows, sizeof(bview_row_t) * self->rect_buffer.h);
+            self->rows_len = self->rect_buffer.h;
+            self->is_dirty = 1;
+        }
+        if (self->is_dirty || self->editor->is_display_dirty || self->rows_key != rows_key) {
+            memset(self->rows, 0, sizeof(bview_row_t) * self->rows_len);
+            _bview_clear_render_lines(self, 0);
+            self->rows_key = rows_key;
+            self->is_dirty = 0;
+        } else if (self->rows_viewport_y != viewport_y) {
+            // Move rows already on screen instead of redrawing them
+            _bview_scroll_rows(self, viewport_y - self->rows_viewport_y);
+        }
+        self->rows_viewport_y = viewport_y;
+    }
+
+    // Render lines and margins
     for (rect_y = 0; rect_y < self->rect_buffer.h; rect_y++) {
         if (viewport_y + rect_y < 0 || viewport_y + rect_y >= self->buffer->line_count) {
+            if (is_row_cached && _bview_is_row_unchanged(self, rect_y, NULL)) {
+                continue;
+            }
             // Draw pre/post blank
             tb_printf_rect(self->rect_lines, 0, rect_y, 0, 0, "%*c", self->linenum_width, '~');
             tb_printf_rect(self->rect_margin_left, 0, rect_y, 0, 0, "%c", ' ');
             tb_printf_rect(self->rect_margin_right, 0, rect_y, 0, 0, "%c", ' ');
             tb_printf_rect(self->rect_buffer, 0, rect_y, 0, 0, "%-*.*s", self->rect_buffer.w, self->rect_buffer.w, " ");
+        } else if (is_row_cached && (row_state = _bview_is_row_unchanged(self, rect_y, bline))) {
+            if (row_state == MLE_ROW_LINENUM_CHANGED) {
+                // Only the relative line number moved with the cursor
+                tb_clear_rect(self->rect_lines.x, self->rect_lines.y + rect_y, self->rect_lines.w, 1);
+                _bview_draw_linenum(self, bline, rect_y);
+            }
+            _bview_keep_render_line(self, bline);
+            bline = bline->next;
         } else {
+            // Clear row as the display is not wiped between frames
+            if (is_row_cached) {
+                tb_clear_rect(self->rect_lines.x, self->rect_buffer.y + rect_y, self->rect_margin_right.x - self->rect_lines.x + 1, 1);
+            }
             // Draw bline at self->rect_buffer self->viewport_mark + rect_y
             _bview_draw_bline(self, bline, rect_y, &bline, &rect_y);
             bline = bline->next;
         }
     }
+
+    // Forget lines that scrolled out of view
+    if (is_row_cached) _bview_clear_render_lines(self, 1);
+    if (self->isearch_rule) _bview_sweep_match_index(self->isearch_index);
 }
 
 static void _bview_draw_bline(bview_t *self, bline_t *bline, int rect_y, bline_t **optret_bline, int *optret_rect_y) {
@@ -1040,6 +1325,8 @@ static void _bview_draw_bline(bview_t *self, bline_t *bline, int rect_y, bline_t
     int is_soft_wrapped;
     int orig_rect_y;
     srule_t *srule;
+    render_line_t *render_line;
+    struct tb_cell *cells;
 
     MLBUF_BLINE_ENSURE_CHARS(bline);
 
@@ -1050,29 +1337,32 @@ static void _bview_draw_bline(bview_t *self, bline_t *bline, int rect_y, bline_t
 
     // Draw linenums and margins
     if (MLE_BVIEW_IS_EDIT(self)) {
-        int linenum_fg = is_cursor_line ? TB_BOLD : 0;
-        if (self->editor->linenum_type == MLE_LINENUM_TYPE_ABS
-            || self->editor->linenum_type == MLE_LINENUM_TYPE_BOTH
-            || (self->editor->linenum_type == MLE_LINENUM_TYPE_REL && is_cursor_line)
-        ) {
-            tb_printf_rect(self->rect_lines, 0, rect_y, linenum_fg, 0, "%*d", self->abs_linenum_width, (int)(bline->line_index + 1) % (int)pow(10, self->linenum_width));
-            if (self->editor->linenum_type == MLE_LINENUM_TYPE_BOTH) {
-                tb_printf_rect(self->rect_lines, self->abs_linenum_width, rect_y, linenum_fg, 0, " %*d", self->rel_linenum_width, (int)labs(bline->line_index - self->active_cursor->mark->bline->line_index));
-            }
-        } else if (self->editor->linenum_type == MLE_LINENUM_TYPE_REL) {
-            tb_printf_rect(self->rect_lines, 0, rect_y, linenum_fg, 0, "%*d", self->rel_linenum_width, (int)labs(bline->line_index - self->active_cursor->mark->bline->line_index));
-        }
+        _bview_draw_linenum(self, bline, rect_y);
         tb_printf_rect(self->rect_margin_left, 0, rect_y, 0, 0, "%c", viewport_x > 0 && bline->char_count > 0 ? '^' : ' ');
         if (!is_soft_wrapped && bline->char_vwidth - viewport_x_vcol > self->rect_buffer.w) {
             tb_printf_rect(self->rect_margin_right, 0, rect_y, 0, 0, "%c", '$');
         }
     }
 
+    // Blit cells rendered for this line in an earlier frame
+    render_line = NULL;
+    if (_bview_is_row_cached(self) && !is_soft_wrapped && tb_cell_buffer()) {
+        render_line = _bview_get_render_line(self, bline, viewport_x, is_cursor_line, _bview_get_range_key(self, bline));
+        if (render_line->cells) {
+            for (i = 0; i < render_line->cells_len; i++) {
+                tb_set_cell(self->rect_buffer.x + i, self->rect_buffer.y + rect_y, render_line->cells[i].ch, render_line->cells[i].fg, render_line->cells[i].bg);
+            }
+            if (optret_bline) *optret_bline = bline;
+            if (optret_rect_y) *optret_rect_y = rect_y;
+            return;
+        }
+    }
+
     // Render 0 thru rect_buffer.w cell by cell
     orig_rect_y = rect_y;
     rect_x = 0;
     char_col = viewport_x;
-    _bview_populate_isearch_ranges(self, bline);
+    _bview_populate_isearch_ranges(self, bline, viewport_x, viewport_x_vcol + self->rect_buffer.w * (is_soft_wrapped ? self->rect_buffer.h : 1));
     while (char_col < bline->char_count) {
         ch = bline->chars[char_col].ch;
         fg = bline->chars[char_col].style.fg;
@@ -1090,7 +1380,7 @@ static void _bview_draw_bline(bview_t *self, bline_t *bline, int rect_y, bline_t
             bg |= TB_REVERSE;
         }
         if (_bview_is_in_isearch(self, char_col, &srule)) {
-        } else if (_bview_is_in_range(bline, char_col, self->active_cursor->is_block, &srule)) {
+        } else if (_bview_is_in_range(self, bline, char_col, &srule)) {
         } else {
             srule = NULL;
         }
@@ -1118,6 +1408,11 @@ static void _bview_draw_bline(bview_t *self, bline_t *bline, int rect_y, bline_t
                 rect_x = 0;
                 rect_y += 1;
                 char_w -= i;
+                // Wrapped rows cover lines below so forget what was there
+                if (_bview_is_row_cached(self)) {
+                    tb_clear_rect(self->rect_lines.x, self->rect_buffer.y + rect_y, self->rect_margin_right.x - self->rect_lines.x + 1, 1);
+                    self->rows[rect_y].is_valid = 0;
+                }
                 // Draw remaining ch on next line
                 for (j = 0; j < char_w && rect_x + j < self->rect_buffer.w; j++) {
                     tb_set_cell(self->rect_buffer.x + j, self->rect_buffer.y + rect_y, ch, fg, bg);
@@ -1135,6 +1430,13 @@ static void _bview_draw_bline(bview_t *self, bline_t *bline, int rect_y, bline_t
         rect_x += char_w;
         char_col += 1;
     }
+    if (render_line) {
+        // Copy rendered cells out of the back buffer for next time
+        cells = tb_cell_buffer() + (ptrdiff_t)(tb_width() * (self->rect_buffer.y + rect_y) + self->rect_buffer.x);
+        render_line->cells_len = self->rect_buffer.w;
+        render_line->cells = malloc(sizeof(struct tb_cell) * render_line->cells_len);
+        memcpy(render_line->cells, cells, sizeof(struct tb_cell) * render_line->cells_len);
+    }
     for (i = orig_rect_y; i < rect_y && bline->next; i++) {
         bline = bline->next;
     }
@@ -1142,10 +1444,51 @@ static void _bview_draw_bline(bview_t *self, bline_t *bline, int rect_y, bline_t
     if (optret_rect_y) *optret_rect_y = rect_y;
 }
 
+// Draw absolute and/or relative line number of bline in the gutter
+static void _bview_draw_linenum(bview_t *self, bline_t *bline, int rect_y) {
+    int is_cursor_line;
+    uint16_t fg;
+    bint_t rel;
+    is_cursor_line = _bview_is_cursor_line(self, bline);
+    fg = is_cursor_line ? TB_BOLD : self->rect_lines.fg;
+    rel = bline->line_index - self->active_cursor->mark->bline->line_index;
+    if (rel < 0) rel = -rel;
+    if (self->editor->linenum_type == MLE_LINENUM_TYPE_ABS
+        || self->editor->linenum_type == MLE_LINENUM_TYPE_BOTH
+        || (self->editor->linenum_type == MLE_LINENUM_TYPE_REL && is_cursor_line)
+    ) {
+        _bview_draw_linenum_int(self, 0, rect_y, self->abs_linenum_width, (bline->line_index + 1) % self->linenum_mod, fg);
+        if (self->editor->linenum_type == MLE_LINENUM_TYPE_BOTH) {
+            tb_set_cell(self->rect_lines.x + self->abs_linenum_width, self->rect_lines.y + rect_y, ' ', fg, self->rect_lines.bg);
+            _bview_draw_linenum_int(self, self->abs_linenum_width + 1, rect_y, self->rel_linenum_width, rel, fg);
+        }
+    } else if (self->editor->linenum_type == MLE_LINENUM_TYPE_REL) {
+        _bview_draw_linenum_int(self, 0, rect_y, self->rel_linenum_width, rel, fg);
+    }
+}
+
+// Draw n right-aligned to width without going through printf
+static void _bview_draw_linenum_int(bview_t *self, int x, int rect_y, int width, bint_t n, uint16_t fg) {
+    char digits[32];
+    int len;
+    int i;
+    len = 0;
+    do {
+        digits[len++] = '0' + (char)(n % 10);
+        n /= 10;
+    } while (n > 0 && len < (int)sizeof(digits));
+    x += self->rect_lines.x;
+    for (i = len; i < width; i++) {
+        tb_set_cell(x++, self->rect_lines.y + rect_y, ' ', fg, self->rect_lines.bg);
+    }
+    while (len > 0) {
+        tb_set_cell(x++, self->rect_lines.y + rect_y, digits[--len], fg, self->rect_lines.bg);
+    }
+}
+
 // Highlight matching bracket pair under mark
 static void _bview_highlight_bracket_pair(bview_t *self, mark_t *mark) {
     bline_t *line;
-    bint_t brkt;
     bint_t col;
     mark_t pair;
     int screen_x;
@@ -1158,7 +1501,7 @@ static void _bview_highlight_bracket_pair(bview_t *self, mark_t *mark) {
         // Not a bracket
         return;
     }
-    if (mark_find_bracket_pair(mark, MLE_BRACKET_PAIR_MAX_SEARCH, &line, &col, &brkt) != MLBUF_OK) {
+    if (_bview_find_bracket_pair(self, mark, &line, &col) != MLE_OK) {
         // No pair found
         return;
     }
@@ -1174,6 +1517,223 @@ static void _bview_highlight_bracket_pair(bview_t *self, mark_t *mark) {
         return;
     }
     tb_set_cell(screen_x, screen_y, cell->ch, cell->fg | TB_UNDERLINE, cell->bg); // TODO configurable
+    _bview_set_row_overlaid(self, screen_y);
+}
+
+// Find bracket pair of mark, remembering the result until the buffer changes
+static int _bview_find_bracket_pair(bview_t *self, mark_t *mark, bline_t **ret_bline, bint_t *ret_col) {
+    bracket_pair_t key;
+    bracket_pair_t *pair;
+    bint_t brkt;
+
+    if (self->bracket_pairs_version != self->buffer->version) {
+        _bview_clear_bracket_pairs(self);
+        self->bracket_pairs_version = self->buffer->version;
+    }
+    memset(&key, 0, sizeof(key));
+    key.bline = mark->bline;
+    key.col = mark->col;
+    HASH_FIND(hh, self->bracket_pairs, &key, offsetof(bracket_pair_t, pair_bline), pair);
+    if (!pair) {
+        pair = calloc(1, sizeof(bracket_pair_t));
+        pair->bline = mark->bline;
+        pair->col = mark->col;
+        pair->is_found = mark_find_bracket_pair(mark, MLE_BRACKET_PAIR_MAX_SEARCH, &pair->pair_bline, &pair->pair_col, &brkt) == MLBUF_OK ? 1 : 0;
+        HASH_ADD(hh, self->bracket_pairs, bline, offsetof(bracket_pair_t, pair_bline), pair);
+    }
+    if (!pair->is_found) return MLE_ERR;
+    *ret_bline = pair->pair_bline;
+    *ret_col = pair->pair_col;
+    return MLE_OK;
+}
+
+// Free cached bracket pairs
+static void _bview_clear_bracket_pairs(bview_t *self) {
+    bracket_pair_t *pair;
+    bracket_pair_t *pair_tmp;
+    HASH_ITER(hh, self->bracket_pairs, pair, pair_tmp) {
+        HASH_DEL(self->bracket_pairs, pair);
+        free(pair);
+    }
+}
+
+// Return a key of everything besides bline contents that affects drawn rows
+static uint64_t _bview_get_rows_key(bview_t *self) {
+    uint64_t vals[7];
+    uint64_t key;
+    size_t i;
+
+    vals[0] = (uint64_t)(uintptr_t)self->buffer;
+    vals[1] = (uint64_t)self->rect_buffer.x << 32 | (uint32_t)self->rect_buffer.y;
+    vals[2] = (uint64_t)self->rect_buffer.w << 32 | (uint32_t)self->rect_buffer.h;
+    vals[3] = (uint64_t)self->rect_lines.x << 32 | (uint32_t)self->rect_lines.w;
+    vals[4] = (uint64_t)self->abs_linenum_width << 32 | (uint32_t)self->rel_linenum_width;
+    vals[5] = (uint64_t)self->editor->linenum_type << 32 | (uint32_t)self->editor->color_col;
+    vals[6] = (uint64_t)self->is_menu;
+
+    // FNV-1a
+    key = 14695981039346656037ULL;
+    for (i = 0; i < 7; i++) {
+        key = (key ^ vals[i]) * 1099511628211ULL;
+    }
+    return key;
+}
+
+// Return a key of the range srule spans on a line in view
+static uint64_t _bview_get_range_key(bview_t *self, bline_t *bline) {
+    bint_t off;
+    int i;
+    uint64_t key;
+    srule_span_t *span;
+
+    off = bline->line_index - self->range_line_index;
+    if (off < 0 || off >= self->range_nlines) return 0;
+
+    // FNV-1a over span bounds
+    key = 14695981039346656037ULL;
+    for (i = self->range_heads[off]; i >= 0; i = span->next) {
+        span = &self->range_spans[i];
+        key = (key ^ (uint64_t)(uintptr_t)span->srule) * 1099511628211ULL;
+        key = (key ^ (uint64_t)span->start_col) * 1099511628211ULL;
+        key = (key ^ (uint64_t)span->end_col) * 1099511628211ULL;
+    }
+    return key;
+}
+
+// Clip range srules (selections) to the lines in view
+static void _bview_index_range_srules(bview_t *self) {
+    if (self->range_spans) free(self->range_spans);
+    if (self->range_heads) free(self->range_heads);
+    self->range_spans = NULL;
+    self->range_heads = NULL;
+    self->range_nlines = 0;
+    if (!self->buffer->range_srules) return;
+    self->range_line_index = self->viewport_mark->bline->line_index;
+    self->range_nlines = self->rect_buffer.h;
+    buffer_get_range_spans(self->buffer, self->range_line_index, self->range_nlines, self->active_cursor->is_block, &self->range_spans, &self->range_heads);
+}
+
+// Return MLE_ROW_UNCHANGED if row would be drawn the same as last time, or
+// MLE_ROW_LINENUM_CHANGED if only its relative line number differs. Else
+// remember it and return 0.
+static int _bview_is_row_unchanged(bview_t *self, int rect_y, bline_t *opt_bline) {
+    bview_row_t row = {0};
+    bview_row_t *prev;
+
+    row.is_valid = 1;
+    if (opt_bline) {
+        MLBUF_BLINE_ENSURE_CHARS(opt_bline);
+        row.bline = opt_bline;
+        row.version = opt_bline->version;
+        row.style_version = opt_bline->style_version;
+        row.viewport_x = _bview_get_viewport_x(self, opt_bline);
+        row.linenum = opt_bline->line_index;
+        row.is_cursor_line = _bview_is_cursor_line(self, opt_bline);
+        row.range_key = _bview_get_range_key(self, opt_bline);
+        if (self->editor->linenum_type != MLE_LINENUM_TYPE_ABS) {
+            row.rel_linenum = labs(opt_bline->line_index - self->active_cursor->mark->bline->line_index);
+        }
+        // A line wrapping onto rows below is redrawn until it unwraps
+        if (_bview_is_soft_wrapped(self, opt_bline) && opt_bline->char_vwidth > self->rect_buffer.w) {
+            row.is_valid = 0;
+        }
+    }
+
+    prev = &self->rows[rect_y];
+    if (prev->is_valid
+        && !prev->is_overlaid
+        && prev->bline == row.bline
+        && prev->version == row.version
+        && prev->style_version == row.style_version
+        && prev->viewport_x == row.viewport_x
+        && prev->linenum == row.linenum
+        && prev->is_cursor_line == row.is_cursor_line
+        && prev->range_key == row.range_key
+    ) {
+        if (prev->rel_linenum == row.rel_linenum) return MLE_ROW_UNCHANGED;
+        prev->rel_linenum = row.rel_linenum;
+        return MLE_ROW_LINENUM_CHANGED;
+    }
+    *prev = row;
+    return 0;
+}
+
+// Return 1 if rows of this bview are drawn incrementally
+static int _bview_is_row_cached(bview_t *self) {
+    return MLE_BVIEW_IS_EDIT(self) ? 1 : 0;
+}
+
+// Find or add a render cache entry for a bline, emptied if stale
+static render_line_t *_bview_get_render_line(bview_t *self, bline_t *bline, bint_t viewport_x, int is_cursor_line, uint64_t range_key) {
+    render_line_t *line;
+    HASH_FIND_PTR(self->render_lines, &bline, line);
+    if (!line) {
+        line = calloc(1, sizeof(render_line_t));
+        line->bline = bline;
+        HASH_ADD_PTR(self->render_lines, bline, line);
+    } else if (line->version != bline->version
+        || line->style_version != bline->style_version
+        || line->viewport_x != viewport_x
+        || line->is_cursor_line != is_cursor_line
+        || line->range_key != range_key
+    ) {
+        if (line->cells) free(line->cells);
+        line->cells = NULL;
+        line->cells_len = 0;
+    }
+    line->version = bline->version;
+    line->style_version = bline->style_version;
+    line->viewport_x = viewport_x;
+    line->is_cursor_line = is_cursor_line;
+    line->range_key = range_key;
+    line->epoch = self->render_epoch;
+    return line;
+}
+
+// Keep the render cache entry of a bline that is still in view
+static void _bview_keep_render_line(bview_t *self, bline_t *bline) {
+    render_line_t *line;
+    HASH_FIND_PTR(self->render_lines, &bline, line);
+    if (line) line->epoch = self->render_epoch;
+}
+
+// Free render cache entries, or only those not drawn this frame
+static void _bview_clear_render_lines(bview_t *self, int is_stale_only) {
+    render_line_t *line, *tmp;
+    HASH_ITER(hh, self->render_lines, line, tmp) {
+        if (is_stale_only && line->epoch == self->render_epoch) continue;
+        HASH_DELETE(hh, self->render_lines, line);
+        if (line->cells) free(line->cells);
+        free(line);
+    }
+}
+
+// Shift drawn rows by delta using the terminal scroll region
+static void _bview_scroll_rows(bview_t *self, bint_t delta) {
+    int n;
+    if (delta >= self->rows_len || -delta >= self->rows_len) return;
+    if (self->rect_lines.x != 0 || self->rect_margin_right.x + 1 != tb_width()) {
+        // Scroll region would also move a neighboring split
+        return;
+    }
+    n = (int)delta;
+    if (tb_scroll(self->rect_buffer.y, self->rect_buffer.h, n) != TB_OK) return;
+    if (n > 0) {
+        memmove(self->rows, self->rows + n, sizeof(bview_row_t) * (self->rows_len - n));
+        memset(self->rows + self->rows_len - n, 0, sizeof(bview_row_t) * n);
+    } else {
+        memmove(self->rows - n, self->rows, sizeof(bview_row_t) * (self->rows_len + n));
+        memset(self->rows, 0, sizeof(bview_row_t) * -n);
+    }
+}
+
+// Mark a row as drawn over so it is redrawn next time
+static void _bview_set_row_overlaid(bview_t *self, int screen_y) {
+    int rect_y;
+    rect_y = screen_y - self->rect_buffer.y;
+    if (rect_y >= 0 && rect_y < self->rows_len) {
+        self->rows[rect_y].is_overlaid = 1;
+    }
 }
 
 // Find screen coordinates for a mark
@@ -1257,18 +1817,16 @@ static int _bview_is_soft_wrapped(bview_t *self, bline_t *bline) {
         && _bview_is_cursor_line(self, bline) ? 1 : 0;
 }
 
-static int _bview_is_in_range(bline_t *bline, bint_t col, int is_block, srule_t **ret_srule) {
-    mark_t mark = {0};
-    srule_node_t *node;
-    mark.bline = bline;
-    mark.col = col;
-    int rv;
-    DL_FOREACH(bline->buffer->range_srules, node) {
-        rv = is_block
-            ? mark_block_is_between(&mark, node->srule->range_a, node->srule->range_b)
-            : mark_is_between(&mark, node->srule->range_a, node->srule->range_b);
-        if (rv) {
-            *ret_srule = node->srule;
+static int _bview_is_in_range(bview_t *self, bline_t *bline, bint_t col, srule_t **ret_srule) {
+    bint_t off;
+    int i;
+    srule_span_t *span;
+    off = bline->line_index - self->range_line_index;
+    if (off < 0 || off >= self->range_nlines) return 0;
+    for (i = self->range_heads[off]; i >= 0; i = span->next) {
+        span = &self->range_spans[i];
+        if (col >= span->start_col && (span->end_col < 0 || col < span->end_col)) {
+            *ret_srule = span->srule;
             return 1;
         }
     }
@@ -1297,36 +1855,473 @@ static int _bview_is_in_isearch(bview_t *self, bint_t col, srule_t **ret_srule)
     return 0;
 }
 
-static int _bview_populate_isearch_ranges(bview_t *self, bline_t *bline) {
-    int rc;
-    PCRE2_SIZE substrs[3];
-    pcre2_code *cre;
-    bint_t look_offset, start, stop;
+// Convert matches visible from start_col up to stop_vcol to col ranges
+static int _bview_populate_isearch_ranges(bview_t *self, bline_t *bline, bint_t start_col, bint_t stop_vcol) {
+    match_line_t *line;
+    bint_t start_index, stop_index, stop_col, start, stop;
+    size_t lo, hi, i;
 
     if (!self->isearch_rule) return MLBUF_OK;
 
-    cre = self->isearch_rule->cre;
     self->isearch_ranges_len = 0;
-    look_offset = 0;
+    line = _bview_get_match_line(self->isearch_index, bline);
+    if (!line) return MLBUF_OK;
+
+    // Find byte window on screen. Very long lines may hold far more matches
+    // than are visible.
+    bline_get_col_from_vcol(bline, stop_vcol, &stop_col);
+    start_index = start_col < bline->char_count ? bline->chars[start_col].index : bline->data_len;
+    stop_index = stop_col < bline->char_count ? bline->chars[stop_col].index : bline->data_len + 1;
+
+    // Find first match ending in window. Stops of non-overlapping matches
+    // never decrease.
+    lo = 0;
+    hi = (size_t)line->num_matches;
+    while (lo < hi) {
+        i = (lo + hi) / 2;
+        if (line->offsets[line->matches[i] + 1] <= start_index) {
+            lo = i + 1;
+        } else {
+            hi = i;
+        }
+    }
+
+    // Convert non-empty matches to col ranges
+    for (i = lo; i < (size_t)line->num_matches && line->offsets[line->matches[i]] < stop_index; i++) {
+        if (line->offsets[line->matches[i] + 1] <= line->offsets[line->matches[i]]) continue;
+        if (self->isearch_ranges_len + 2 > self->isearch_ranges_cap) {
+            self->isearch_ranges_cap = 2 * MLE_MAX(self->isearch_ranges_cap, 2);
+            self->isearch_ranges = realloc(self->isearch_ranges, sizeof(bint_t) * self->isearch_ranges_cap);
+        }
+        bline_index_to_col(bline, line->offsets[line->matches[i]], &start);
+        bline_index_to_col(bline, line->offsets[line->matches[i] + 1], &stop);
+        self->isearch_ranges[self->isearch_ranges_len++] = start;
+        self->isearch_ranges[self->isearch_ranges_len++] = stop;
+    }
+
+    return MLBUF_OK;
+}
+
+// Set index regex. If opt_regex is a literal that extends the previous
+// literal, narrow cached matches instead of discarding them.
+static int _bview_set_match_index(match_index_t *index, char *opt_regex, int regex_len) {
+    int is_literal;
+    int prev_len;
+    int errcode;
+    PCRE2_SIZE erroffset;
+    pcre2_code *cre;
+
+    if (!opt_regex || regex_len < 1) {
+        _bview_clear_match_index(index);
+        if (index->cre) pcre2_code_free(index->cre);
+        if (index->regex) free(index->regex);
+        index->cre = NULL;
+        index->regex = NULL;
+        return MLE_OK;
+    }
 
-    while (look_offset < bline->data_len) {
-        rc = pcre2_match(cre, (PCRE2_SPTR)bline->data, (PCRE2_SIZE)bline->data_len, (PCRE2_SIZE)look_offset, 0, pcre2_md, NULL);
+    // Keep matches for the same regex
+    if (index->regex && (int)strlen(index->regex) == regex_len && strncmp(index->regex, opt_regex, regex_len) == 0) {
+        return MLE_OK;
+    }
+
+    cre = pcre2_compile((PCRE2_SPTR)opt_regex, (PCRE2_SIZE)regex_len, PCRE2_NO_AUTO_CAPTURE | PCRE2_CASELESS, &errcode, &erroffset, NULL);
+    if (!cre) {
+        _bview_set_match_index(index, NULL, 0);
+        return MLE_ERR;
+    }
+
+    is_literal = _bview_is_literal_re(opt_regex, regex_len);
+    prev_len = index->regex ? (int)strlen(index->regex) : 0;
+    if (is_literal
+        && index->is_literal
+        && prev_len > 0
+        && regex_len >= prev_len
+        && strncmp(index->regex, opt_regex, prev_len) == 0
+    ) {
+        _bview_narrow_match_index(index, opt_regex, regex_len);
+    } else {
+        _bview_clear_match_index(index);
+    }
+
+    if (index->cre) pcre2_code_free(index->cre);
+    if (index->regex) free(index->regex);
+    index->cre = cre;
+    index->regex = strndup(opt_regex, regex_len);
+    index->is_literal = is_literal;
+    return MLE_OK;
+}
+
+// Return cached matches for bline, matching the line if the cache is missing
+// or stale. Return NULL if there are no matches.
+static match_line_t *_bview_get_match_line(match_index_t *index, bline_t *bline) {
+    match_line_t *line;
+
+    HASH_FIND_PTR(index->lines, &bline, line);
+    if (line && line->version == bline->version) {
+        line->epoch = index->epoch;
+        return line;
+    } else if (line) {
+        _bview_destroy_match_line(index, line);
+        line = NULL;
+    }
+
+    line = _bview_new_match_line(index, bline);
+    if (!line) return NULL;
+    line->epoch = index->epoch;
+    HASH_ADD_PTR(index->lines, bline, line);
+    return line;
+}
+
+// Match bline and return its matches, or NULL if there are none. For literals,
+// include overlapping matches so the set can be narrowed later if the literal
+// is extended. A sorted index keeps every match start, stepping one char past
+// each, so it stops wherever a forward scan from the cursor would.
+static match_line_t *_bview_new_match_line(match_index_t *index, bline_t *bline) {
+    int rc;
+    PCRE2_SIZE substrs[3];
+    match_line_t *line;
+    bint_t look_offset;
+    size_t offsets_cap;
+
+    MLBUF_BLINE_ENSURE_CHARS(bline);
+    line = NULL;
+    look_offset = 0;
+    offsets_cap = 0;
+    while (look_offset <= bline->data_len) {
+        rc = pcre2_match(index->cre, (PCRE2_SPTR)(bline->data ? bline->data : ""), (PCRE2_SIZE)bline->data_len, (PCRE2_SIZE)look_offset, 0, pcre2_md, NULL);
         if (rc < 0) break;
         memcpy(substrs, pcre2_get_ovector_pointer(pcre2_md), 3 * sizeof(PCRE2_SIZE));
         if (substrs[1] == PCRE2_UNSET) break;
-        self->isearch_ranges_len += 2;
-        if (self->isearch_ranges_len > self->isearch_ranges_cap) {
-            while (self->isearch_ranges_len > self->isearch_ranges_cap) {
-                self->isearch_ranges_cap = 2 * MLE_MAX(self->isearch_ranges_cap, 2);
+        if (!line) line = calloc(1, sizeof(match_line_t));
+        if (line->offsets_len + 2 > offsets_cap) {
+            offsets_cap = 2 * MLE_MAX(offsets_cap, 2);
+            line->offsets = realloc(line->offsets, sizeof(bint_t) * offsets_cap);
+        }
+        line->offsets[line->offsets_len++] = (bint_t)substrs[0];
+        line->offsets[line->offsets_len++] = (bint_t)substrs[1];
+        if (index->is_sorted) {
+            look_offset = (bint_t)substrs[0] + 1;
+            while (look_offset < bline->data_len && (bline->data[look_offset] & 0xc0) == 0x80) look_offset += 1;
+        } else if (index->is_literal || substrs[1] <= substrs[0]) {
+            look_offset = (bint_t)substrs[0] + 1;
+        } else {
+            look_offset = (bint_t)substrs[1];
+        }
+    }
+    if (!line) return NULL;
+
+    line->bline = bline;
+    line->version = bline->version;
+    if (!index->is_sorted) _bview_index_match_line(line);
+    return line;
+}
+
+// Drop cached matches that do not match the extended literal regex
+static void _bview_narrow_match_index(match_index_t *index, char *regex, int regex_len) {
+    match_line_t *line;
+    match_line_t *line_tmp;
+    bline_t *bline;
+    size_t i, j;
+    int k;
+    char a, b;
+
+    HASH_ITER(hh, index->lines, line, line_tmp) {
+        bline = line->bline;
+        for (i = 0, j = 0; i < line->offsets_len; i += 2) {
+            if (line->offsets[i] + regex_len > bline->data_len) continue;
+            for (k = 0; k < regex_len; k++) {
+                a = bline->data[line->offsets[i] + k];
+                b = regex[k];
+                if (a >= 'A' && a <= 'Z') a += 'a' - 'A';
+                if (b >= 'A' && b <= 'Z') b += 'a' - 'A';
+                if (a != b) break;
             }
-            self->isearch_ranges = realloc(self->isearch_ranges, sizeof(bint_t) * self->isearch_ranges_cap);
+            if (k < regex_len) continue;
+            line->offsets[j++] = line->offsets[i];
+            line->offsets[j++] = line->offsets[i] + regex_len;
+        }
+        line->offsets_len = j;
+        if (line->offsets_len < 1) {
+            _bview_destroy_match_line(index, line);
+        } else {
+            _bview_index_match_line(line);
         }
-        bline_index_to_col(bline, substrs[0], &start);
-        bline_index_to_col(bline, substrs[1], &stop);
-        self->isearch_ranges[self->isearch_ranges_len - 2] = start;
-        self->isearch_ranges[self->isearch_ranges_len - 1] = stop;
-        look_offset = MLBUF_MAX(stop, look_offset + 1);
     }
+    _bview_reset_match_count(index);
+}
 
-    return MLBUF_OK;
+// Free all cached matches
+static void _bview_clear_match_index(match_index_t *index) {
+    match_line_t *line;
+    match_line_t *line_tmp;
+    HASH_ITER(hh, index->lines, line, line_tmp) {
+        _bview_destroy_match_line(index, line);
+    }
+    _bview_reset_match_count(index);
+    if (index->sorted) free(index->sorted);
+    index->sorted = NULL;
+    index->sorted_cap = 0;
+}
+
+// Start counting matches over from the first line
+static void _bview_reset_match_count(match_index_t *index) {
+    size_t i;
+    for (i = 0; i < index->sorted_len; i++) {
+        _bview_free_match_line(index->sorted[i]);
+    }
+    index->sorted_len = 0;
+    index->numbered_len = 0;
+    index->count = 0;
+    index->count_line = NULL;
+    index->is_counted = 0;
+}
+
+// Adjust count by the matches on lines changed by action. Only the lines
+// before the edit are rebuilt from action data, not the whole buffer. If the
+// count is still under way, start it over instead.
+static void _bview_update_match_count(match_index_t *index, baction_t *action) {
+    bline_t *bline;
+    bline_t *end_line;
+    bint_t start_index;
+    bint_t end_index;
+    bint_t i;
+    str_t old_data = {0};
+
+    if (!index->cre) return;
+    if (!index->is_counted) {
+        _bview_reset_match_count(index);
+        return;
+    } else if (index->is_sorted) {
+        _bview_update_sorted_matches(index, action);
+        return;
+    }
+
+    bline = action->start_line;
+    MLBUF_BLINE_ENSURE_CHARS(bline);
+    start_index = action->start_col < bline->char_count ? bline->chars[action->start_col].index : bline->data_len;
+    if (action->type == MLBUF_BACTION_TYPE_REPLACE) {
+        // Whole lines were replaced
+        index->count -= _bview_count_matches(index, action->del_data, action->del_data_len);
+        index->count += _bview_count_matches(index, action->data, action->data_len);
+    } else if (action->type == MLBUF_BACTION_TYPE_DELETE) {
+        // Line held the deleted data at start_col
+        str_append_len(&old_data, bline->data, start_index);
+        str_append_len(&old_data, action->data, action->data_len);
+        str_append_len(&old_data, bline->data + start_index, bline->data_len - start_index);
+        index->count -= _bview_count_matches(index, old_data.data, (bint_t)old_data.len);
+        index->count += _bview_count_matches(index, bline->data, bline->data_len);
+    } else {
+        // Line was the inserted lines without the inserted data
+        end_line = action->maybe_end_line;
+        MLBUF_BLINE_ENSURE_CHARS(end_line);
+        end_index = action->maybe_end_col < end_line->char_count ? end_line->chars[action->maybe_end_col].index : end_line->data_len;
+        str_append_len(&old_data, bline->data, start_index);
+        str_append_len(&old_data, end_line->data + end_index, end_line->data_len - end_index);
+        index->count -= _bview_count_matches(index, old_data.data, (bint_t)old_data.len);
+        for (i = 0; bline && i <= action->line_delta; i++, bline = bline->next) {
+            index->count += _bview_count_matches(index, bline->data, bline->data_len);
+        }
+    }
+    str_free(&old_data);
+}
+
+// Rematch the lines changed by action and shift the line index of sorted
+// lines after them. Lines are located by the line index the action was made
+// at, so sorted stays in buffer order without walking the buffer.
+static void _bview_update_sorted_matches(match_index_t *index, baction_t *action) {
+    match_line_t *line;
+    match_line_t **added;
+    bline_t *bline;
+    bint_t first, old_last, new_last, line_index;
+    size_t lo, hi, i, added_len, added_cap;
+
+    // Find lines the action replaced
+    first = action->start_line_index;
+    if (action->type == MLBUF_BACTION_TYPE_REPLACE) {
+        new_last = action->maybe_end_line_index;
+    } else {
+        new_last = first + MLE_MAX(action->line_delta, 0);
+    }
+    old_last = new_last - action->line_delta;
+
+    // Drop their matches
+    lo = _bview_find_sorted_line(index, first);
+    for (hi = lo; hi < index->sorted_len && index->sorted[hi]->line_index <= old_last; hi++) {
+        index->count -= (bint_t)index->sorted[hi]->offsets_len / 2;
+        _bview_free_match_line(index->sorted[hi]);
+    }
+
+    // Match the lines that took their place
+    added = NULL;
+    added_len = 0;
+    added_cap = 0;
+    bline = action->start_line;
+    for (line_index = first; bline && line_index <= new_last; line_index++, bline = bline->next) {
+        line = _bview_new_match_line(index, bline);
+        if (!line) continue;
+        line->line_index = line_index;
+        if (added_len + 1 > added_cap) {
+            added_cap = 2 * MLE_MAX(added_cap, 4);
+            added = realloc(added, sizeof(match_line_t*) * added_cap);
+        }
+        added[added_len++] = line;
+        index->count += (bint_t)line->offsets_len / 2;
+    }
+
+    // Splice them in and shift the lines after
+    if (index->sorted_len - (hi - lo) + added_len > index->sorted_cap) {
+        index->sorted_cap = 2 * MLE_MAX(index->sorted_len - (hi - lo) + added_len, 8);
+        index->sorted = realloc(index->sorted, sizeof(match_line_t*) * index->sorted_cap);
+    }
+    if (hi < index->sorted_len) {
+        memmove(index->sorted + lo + added_len, index->sorted + hi, sizeof(match_line_t*) * (index->sorted_len - hi));
+    }
+    index->sorted_len = index->sorted_len - (hi - lo) + added_len;
+    if (added_len > 0) memcpy(index->sorted + lo, added, sizeof(match_line_t*) * added_len);
+    if (action->line_delta != 0) {
+        for (i = lo + added_len; i < index->sorted_len; i++) {
+            index->sorted[i]->line_index += action->line_delta;
+        }
+    }
+    index->numbered_len = MLE_MIN(index->numbered_len, lo);
+    if (added) free(added);
+}
+
+// Return position of first sorted line at or after line_index
+static size_t _bview_find_sorted_line(match_index_t *index, bint_t line_index) {
+    size_t lo, hi, i;
+    lo = 0;
+    hi = index->sorted_len;
+    while (lo < hi) {
+        i = (lo + hi) / 2;
+        if (index->sorted[i]->line_index < line_index) {
+            lo = i + 1;
+        } else {
+            hi = i;
+        }
+    }
+    return lo;
+}
+
+// Number match starts on sorted lines changed since the last call
+static void _bview_number_sorted_matches(match_index_t *index) {
+    match_line_t *prev;
+    size_t i;
+    for (i = index->numbered_len; i < index->sorted_len; i++) {
+        prev = i > 0 ? index->sorted[i - 1] : NULL;
+        index->sorted[i]->nth = prev ? prev->nth + (bint_t)prev->offsets_len / 2 : 0;
+    }
+    index->numbered_len = index->sorted_len;
+}
+
+// Return number of match starts in line before max_offset
+static bint_t _bview_count_match_starts(match_line_t *line, bint_t max_offset) {
+    size_t lo, hi, i;
+    lo = 0;
+    hi = line->offsets_len / 2;
+    while (lo < hi) {
+        i = (lo + hi) / 2;
+        if (line->offsets[2 * i] < max_offset) {
+            lo = i + 1;
+        } else {
+            hi = i;
+        }
+    }
+    return (bint_t)lo;
+}
+
+// Free cached matches for lines not drawn since the last sweep
+static void _bview_sweep_match_index(match_index_t *index) {
+    match_line_t *line;
+    match_line_t *line_tmp;
+    HASH_ITER(hh, index->lines, line, line_tmp) {
+        if (line->epoch != index->epoch) _bview_destroy_match_line(index, line);
+    }
+    index->epoch += 1;
+}
+
+// Return number of non-overlapping matches on each line in data
+static bint_t _bview_count_matches(match_index_t *index, char *data, bint_t data_len) {
+    int rc;
+    PCRE2_SIZE *substrs;
+    char *line;
+    char *newline;
+    bint_t line_len;
+    bint_t look_offset;
+    bint_t count;
+    count = 0;
+    line = data ? data : "";
+    while (1) {
+        newline = data_len > 0 ? memchr(line, '\n', data_len) : NULL;
+        line_len = newline ? (bint_t)(newline - line) : data_len;
+        look_offset = 0;
+        while (look_offset <= line_len) {
+            rc = pcre2_match(index->cre, (PCRE2_SPTR)line, (PCRE2_SIZE)line_len, (PCRE2_SIZE)look_offset, 0, pcre2_md, NULL);
+            if (rc < 0) break;
+            substrs = pcre2_get_ovector_pointer(pcre2_md);
+            if (substrs[1] == PCRE2_UNSET) break;
+            count += 1;
+            look_offset = substrs[1] > substrs[0] ? (bint_t)substrs[1] : (bint_t)substrs[0] + 1;
+        }
+        if (!newline) break;
+        data_len -= line_len + 1;
+        line = newline + 1;
+    }
+    return count;
+}
+
+// Free cached matches for one line
+static void _bview_destroy_match_line(match_index_t *index, match_line_t *line) {
+    HASH_DEL(index->lines, line);
+    _bview_free_match_line(line);
+}
+
+// Free matches for one line not in the lines hash
+static void _bview_free_match_line(match_line_t *line) {
+    if (line->offsets) free(line->offsets);
+    if (line->matches) free(line->matches);
+    free(line);
+}
+
+// Pick out non-overlapping matches in line so lookups need not walk offsets
+static void _bview_index_match_line(match_line_t *line) {
+    bint_t last_stop;
+    size_t i;
+    line->matches = realloc(line->matches, sizeof(size_t) * MLE_MAX(line->offsets_len / 2, 1));
+    line->num_matches = 0;
+    last_stop = -1;
+    for (i = 0; i < line->offsets_len; i += 2) {
+        if (line->offsets[i] < last_stop) continue;
+        last_stop = MLE_MAX(line->offsets[i + 1], line->offsets[i] + 1);
+        line->matches[line->num_matches++] = i;
+    }
+}
+
+// Return 1 if re has no regex metacharacters
+static int _bview_is_literal_re(char *re, int re_len) {
+    int i;
+    for (i = 0; i < re_len; i++) {
+        if (strchr("\\^$.|?*+()[]{}", re[i])) { // Also catches '\0'
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Compare cursors by mark position for DL_SORT
+static int _bview_cmp_cursors(cursor_t *a, cursor_t *b) {
+    return mark_cmp(a->mark, b->mark, NULL, NULL);
+}
+
+// Return 1 if adjacent cursors a and b have the same mark, anchor, and state
+static int _bview_is_cursor_collapsed(cursor_t *a, cursor_t *b) {
+    if (a->is_asleep != b->is_asleep
+        || a->is_anchored != b->is_anchored
+        || a->is_block != b->is_block
+        || !mark_is_eq(a->mark, b->mark)
+    ) {
+        return 0;
+    }
+    return a->is_anchored ? mark_is_eq(a->anchor, b->anchor) : 1;
 }
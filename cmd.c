@@ -22,6 +22,20 @@
     } \
 } while (0)
 
+// Cursors are kept in document order (bview_sort_cursors), so walking them
+// from the tail edits bottom-up and each edit leaves the rest in place
+#define MLE_FOREACH_CURSOR_MARK_EDIT_FN(pcursor, pfn, ...) do { \
+    cursor_t *cursor_tmp; \
+    int is_multi; \
+    is_multi = (pcursor)->bview->cursors->next ? 1 : 0; \
+    if (is_multi) buffer_begin_transaction((pcursor)->bview->buffer); \
+    for (cursor_tmp = (pcursor)->bview->cursors->prev; ; cursor_tmp = cursor_tmp->prev) { \
+        if (!cursor_tmp->is_asleep) pfn(cursor_tmp->mark, __VA_ARGS__); \
+        if (cursor_tmp == (pcursor)->bview->cursors) break; \
+    } \
+    if (is_multi) buffer_commit_transaction((pcursor)->bview->buffer); \
+} while (0)
+
 #define MLE_FOREACH_CURSOR_EX(pcursor, pctmp) \
     DL_FOREACH((pcursor)->bview->cursors, (pctmp)) \
         if (!(pctmp)->is_asleep)
@@ -39,7 +53,8 @@ static int _cmd_pre_close(editor_t *editor, bview_t *bview);
 static int _cmd_save(editor_t *editor, bview_t *bview, int save_as);
 static int _cmd_search_ex(cmd_context_t *ctx, int is_prev);
 static int _cmd_search_next_ex(cmd_context_t *ctx, int is_prev);
-static int _cmd_search_next(bview_t *bview, cursor_t *cursor, mark_t *search_mark, char *regex, int regex_len, int is_prev);
+static int _cmd_search_next(bview_t *bview, cursor_t *cursor, mark_t *search_mark, int is_prev, bint_t *optret_nth);
+static void _cmd_search_show_match(bview_t *bview, bint_t nth);
 static int _cmd_find_word_ex(cmd_context_t *ctx, int is_prev);
 static void _cmd_aproc_bview_passthru_cb(aproc_t *aproc, char *buf, size_t buf_len);
 static void _cmd_isearch_prompt_cb(bview_t *bview_prompt, baction_t *action, void *udata);
@@ -50,11 +65,13 @@ static int _cmd_menu_blist_cb(cmd_context_t *ctx);
 static void _cmd_insert_auto_indent_newline(cmd_context_t *ctx);
 static void _cmd_insert_auto_indent_closing_bracket(cmd_context_t *ctx);
 static void _cmd_shell_apply_cmd(cmd_context_t *ctx, char *cmd);
+static void _cmd_shell_apply_output(cursor_t *cursor, char *output, size_t output_len);
 static void _cmd_get_input(cmd_context_t *ctx, kinput_t *ret_input);
 static int _cmd_fsearch_inner(cmd_context_t *ctx, char *shell_cmd);
 static int _cmd_get_char_param(cmd_context_t *ctx, char *ret_ch);
 static int _cmd_move_page_y(cmd_context_t *ctx, int full_y, int is_up);
 static int _cmd_pre_close_ok_to_close_bview(editor_t *editor, bview_t *bview);
+static int _cmd_align_mark(mark_t *mark, bint_t col);
 
 // Insert data
 int cmd_insert_data(cmd_context_t *ctx) {
@@ -115,7 +132,7 @@ int cmd_insert_data(cmd_context_t *ctx) {
         char *trimmed = NULL;
         int trimmed_len = 0;
         util_pcre_replace("(?m) +$", ctx->editor->insertbuf, "", &trimmed, &trimmed_len);
-        MLE_FOREACH_CURSOR_MARK_FN(ctx->cursor, mark_insert_func, trimmed, trimmed_len);
+        MLE_FOREACH_CURSOR_MARK_EDIT_FN(ctx->cursor, mark_insert_func, trimmed, trimmed_len);
         free(trimmed);
     } else if (ctx->editor->auto_indent && !ctx->cursor->next && !ctx->cursor->is_block && insertbuf_len == 1 && ctx->editor->insertbuf[0] == '\n') {
         _cmd_insert_auto_indent_newline(ctx);
@@ -123,7 +140,7 @@ int cmd_insert_data(cmd_context_t *ctx) {
         _cmd_insert_auto_indent_closing_bracket(ctx);
     } else {
         // Insert without trim
-        MLE_FOREACH_CURSOR_MARK_FN(ctx->cursor, mark_insert_func, ctx->editor->insertbuf, insertbuf_len);
+        MLE_FOREACH_CURSOR_MARK_EDIT_FN(ctx->cursor, mark_insert_func, ctx->editor->insertbuf, insertbuf_len);
     }
 
     // Remember last insert data
@@ -157,16 +174,14 @@ int cmd_insert_newline_below(cmd_context_t *ctx) {
 
 // Delete char before cursor mark
 int cmd_delete_before(cmd_context_t *ctx) {
-    bint_t offset;
-    mark_get_offset(ctx->cursor->mark, &offset);
-    if (offset < 1) return MLE_OK;
-    MLE_FOREACH_CURSOR_MARK_FN(ctx->cursor, mark_delete_before, 1);
+    if (!ctx->cursor->mark->bline->prev && ctx->cursor->mark->col < 1) return MLE_OK;
+    MLE_FOREACH_CURSOR_MARK_EDIT_FN(ctx->cursor, mark_delete_before, 1);
     return MLE_OK;
 }
 
 // Delete char after cursor mark
 int cmd_delete_after(cmd_context_t *ctx) {
-    MLE_FOREACH_CURSOR_MARK_FN(ctx->cursor, mark_delete_after, 1);
+    MLE_FOREACH_CURSOR_MARK_EDIT_FN(ctx->cursor, mark_delete_after, 1);
     return MLE_OK;
 }
 
@@ -396,11 +411,7 @@ int cmd_align_cursors(cmd_context_t *ctx) {
             max_col = cursor->mark->col;
         }
     }
-    MLE_FOREACH_CURSOR_EX(ctx->cursor, cursor) {
-        while (cursor->mark->col < max_col) {
-            mark_insert_before(cursor->mark, " ", 1);
-        }
-    }
+    MLE_FOREACH_CURSOR_MARK_EDIT_FN(ctx->cursor, _cmd_align_mark, max_col);
     return MLE_OK;
 }
 
@@ -507,24 +518,30 @@ int cmd_replace(cmd_context_t *ctx) {
     return cursor_replace(ctx->cursor, 1, NULL, NULL);
 }
 
-// Interactive search and replace on all buffers
+// Interactive search and replace on all buffers. If static_param is "all",
+// replace in every buffer without prompting.
 int cmd_replace_all(cmd_context_t *ctx) {
     bview_t *bview, *bview_orig;
-    int num_bviews, do_replace_all, num_replacements, num_replacements_tmp;
-    int cancelled, buffer_done_i, i, already_done;
+    int do_replace_all, num_replacements, num_replacements_tmp, num_buffers;
+    int cancelled;
     char *regex, *replacement;
-    buffer_t **buffer_done;
+    buffer_seen_t *seen, *seen_tmp, *buffers_seen;
+    pcre2_code *cre;
+    int errcode;
+    PCRE2_SIZE erroffset;
+    PCRE2_UCHAR errstr[128];
+    bint_t num_repls;
+    mark_t *lo, *hi;
 
     bview_orig = ctx->bview;
-    do_replace_all = 0;
+    do_replace_all = ctx->static_param && strcmp(ctx->static_param, "all") == 0 ? 1 : 0;
     num_replacements = 0;
+    num_buffers = 0;
     cancelled = 0;
     regex = NULL;
     replacement = NULL;
-    CDL_COUNT2(ctx->editor->all_bviews, bview, num_bviews, all_next);
-    if (num_bviews <= 0) return MLE_OK;
-    buffer_done = calloc(num_bviews, sizeof(buffer_t *));
-    buffer_done_i = 0;
+    buffers_seen = NULL;
+    cre = NULL;
 
     do {
         editor_prompt(ctx->editor, "replace_all: Search regex?", NULL, &regex);
@@ -532,37 +549,59 @@ int cmd_replace_all(cmd_context_t *ctx) {
         editor_prompt(ctx->editor, "replace_all: Replacement string?", NULL, &replacement);
         if (!replacement) break;
 
+        // Compile once for buffers replaced in bulk
+        cre = pcre2_compile((PCRE2_SPTR)regex, (PCRE2_SIZE)strlen(regex), PCRE2_CASELESS, &errcode, &erroffset, NULL);
+        if (!cre) {
+            pcre2_get_error_message(errcode, errstr, sizeof(errstr));
+            MLE_SET_ERR(ctx->editor, "replace_all: Bad regex at offset %d: %s", (int)erroffset, (char*)errstr);
+            free(regex);
+            free(replacement);
+            return MLE_ERR;
+        }
+
         CDL_FOREACH2(ctx->editor->all_bviews, bview, all_next) {
             if (!MLE_BVIEW_IS_EDIT(bview)) continue;
 
-            // Check if buffer in done list
-            // TODO inefficient, could replace with hash
-            for (i = 0, already_done = 0; i < buffer_done_i; i++) {
-                if (buffer_done[i] == bview->buffer) {
-                    already_done = 1;
-                    break;
+            // Skip buffers already done
+            HASH_FIND_PTR(buffers_seen, &bview->buffer, seen);
+            if (seen) continue;
+            seen = calloc(1, sizeof(buffer_seen_t));
+            seen->buffer = bview->buffer;
+            HASH_ADD_PTR(buffers_seen, buffer, seen);
+            num_buffers += 1;
+
+            if (do_replace_all) {
+                // Replace selection, or whole buffer, in one action without
+                // activating bview
+                num_repls = 0;
+                if (cursor_get_lo_hi(bview->active_cursor, &lo, &hi) == MLE_OK) {
+                    mark_replace_all_cre_between(lo, hi, cre, replacement, &num_repls);
+                } else {
+                    buffer_replace_all_cre(bview->buffer, bview->buffer->first_line, 0, bview->buffer->last_line, bview->buffer->last_line->char_count, cre, replacement, &num_repls);
                 }
+                num_replacements += (int)num_repls;
+                continue;
             }
-            if (already_done) continue;
 
             // Search and replace on this bview
             editor_set_active(ctx->editor, bview);
             cursor_replace_ex(bview->active_cursor, 1, regex, replacement, "replace_all", &do_replace_all, &num_replacements_tmp, &cancelled);
             num_replacements += num_replacements_tmp;
-
-            // Add buffer to done list
-            buffer_done[buffer_done_i++] = bview->buffer;
             if (cancelled) break;
         }
     } while (0);
 
     editor_set_active(ctx->editor, bview_orig);
 
-    MLE_SET_INFO(ctx->editor, "replace_all: Replaced %d instance(s) in %d buffer(s)", num_replacements, buffer_done_i);
+    MLE_SET_INFO(ctx->editor, "replace_all: Replaced %d instance(s) in %d buffer(s)", num_replacements, num_buffers);
 
     if (regex) free(regex);
     if (replacement) free(replacement);
-    if (buffer_done) free(buffer_done);
+    if (cre) pcre2_code_free(cre);
+    HASH_ITER(hh, buffers_seen, seen, seen_tmp) {
+        HASH_DEL(buffers_seen, seen);
+        free(seen);
+    }
 
     return MLE_OK;
 }
@@ -632,10 +671,7 @@ int cmd_isearch(cmd_context_t *ctx) {
         .kmap = ctx->editor->kmap_prompt_isearch,
         .prompt_cb = _cmd_isearch_prompt_cb
     }, NULL);
-    if (ctx->bview->isearch_rule) {
-        srule_destroy(ctx->bview->isearch_rule);
-        ctx->bview->isearch_rule = NULL;
-    }
+    bview_set_isearch(ctx->bview, NULL, 0);
     return MLE_OK;
 }
 
@@ -786,34 +822,30 @@ int cmd_fsearch_fzy(cmd_context_t *ctx) {
     return _cmd_fsearch_inner(ctx, shell_cmd);
 }
 
-// Grep for pattern in cwd
+// Grep for pattern in cwd. The built-in grep skips binary and .gitignore'd
+// files and runs in a child proc so the editor stays responsive. A static
+// param overrides it with an external grep command.
 int cmd_grep(cmd_context_t *ctx) {
     aproc_t *aproc;
     char *path;
     char *path_arg;
     char *cmd;
-    char *grep_fmt;
     editor_prompt(ctx->editor, "grep: Pattern?", NULL, &path);
     if (!path) return MLE_OK;
-    if (ctx->static_param) {
-        grep_fmt = ctx->static_param;
+    if (!ctx->static_param) {
+        aproc = aproc_new_grep(ctx->editor, ctx->bview, &(ctx->bview->aproc), path, ".", _cmd_aproc_bview_passthru_cb);
+        free(path);
     } else {
-        #ifdef __APPLE__
-        grep_fmt = "grep --color=never -E -i -I -n -r %s . 2>/dev/null";
-        #else
-        grep_fmt = "grep --color=never -P -i -I -n -r %s . 2>/dev/null";
-        #endif
-    }
-    path_arg = util_escape_shell_arg(path, strlen(path));
-    free(path);
-    asprintf(&cmd, grep_fmt, path_arg);
-    free(path_arg);
-    if (!cmd) {
-        MLE_RETURN_ERR(ctx->editor, "Failed to format grep cmd: %s", grep_fmt);
+        path_arg = util_escape_shell_arg(path, strlen(path));
+        free(path);
+        asprintf(&cmd, ctx->static_param, path_arg);
+        free(path_arg);
+        if (!cmd) {
+            MLE_RETURN_ERR(ctx->editor, "Failed to format grep cmd: %s", ctx->static_param);
+        }
+        aproc = aproc_new(ctx->editor, ctx->bview, &(ctx->bview->aproc), cmd, 0, _cmd_aproc_bview_passthru_cb);
+        free(cmd);
     }
-
-    aproc = aproc_new(ctx->editor, ctx->bview, &(ctx->bview->aproc), cmd, 0, _cmd_aproc_bview_passthru_cb);
-    free(cmd);
     if (!aproc) return MLE_ERR;
     editor_menu(ctx->editor, _cmd_menu_grep_cb, NULL, 0, aproc, NULL);
     return MLE_OK;
@@ -1144,6 +1176,26 @@ int cmd_redo(cmd_context_t *ctx) {
     return MLE_OK;
 }
 
+// Redo into the next undo tree branch at this point in history
+int cmd_redo_branch(cmd_context_t *ctx) {
+    if (buffer_switch_undo_branch(ctx->bview->buffer) != MLBUF_OK) {
+        return MLE_OK;
+    }
+    return cmd_redo(ctx);
+}
+
+// Undo to the previous state in time, across undo tree branches
+int cmd_undo_earlier(cmd_context_t *ctx) {
+    buffer_undo_earlier(ctx->bview->buffer, ctx->editor->coarse_undo);
+    return MLE_OK;
+}
+
+// Redo to the next state in time, across undo tree branches
+int cmd_undo_later(cmd_context_t *ctx) {
+    buffer_undo_later(ctx->bview->buffer, ctx->editor->coarse_undo);
+    return MLE_OK;
+}
+
 // Indent line(s)
 int cmd_indent(cmd_context_t *ctx) {
     return _cmd_indent(ctx, 0);
@@ -1159,6 +1211,7 @@ int cmd_set_opt(cmd_context_t *ctx) {
     char *prompt;
     char *val;
     int vali;
+    bview_t *bview;
     if (!ctx->static_param) return MLE_ERR;
     asprintf(&prompt, "set_opt: %s?", ctx->static_param);
     editor_prompt(ctx->editor, prompt, NULL, &val);
@@ -1177,6 +1230,9 @@ int cmd_set_opt(cmd_context_t *ctx) {
         ctx->bview->soft_wrap = vali ? 1 : 0;
     } else if (strcmp(ctx->static_param, "coarse_undo") == 0) {
         ctx->editor->coarse_undo = vali ? 1 : 0;
+        CDL_FOREACH2(ctx->editor->all_bviews, bview, all_next) {
+            buffer_set_undo_coalesced(bview->buffer, ctx->editor->coarse_undo);
+        }
     } else if (strcmp(ctx->static_param, "mouse_support") == 0) {
         ctx->editor->mouse_support = vali ? 1 : 0;
         editor_set_input_mode(ctx->editor);
@@ -1279,7 +1335,10 @@ int cmd_jump(cmd_context_t *ctx) {
             mark_move_by(mark, 2);
         }
         if (jumpi < 1) break;
-        if (!headless) tb_present();
+        if (!headless) {
+            tb_present();
+            ctx->editor->is_display_dirty = 1;
+        }
 
         // Get 2 inputs
         _cmd_get_input(ctx, &ev[0]); if (ev[0].ch < 'a' || ev[0].ch > 'z') break;
@@ -1679,44 +1738,68 @@ static int _cmd_save(editor_t *editor, bview_t *bview, int save_as) {
 // Search for a regex
 static int _cmd_search_ex(cmd_context_t *ctx, int is_prev) {
     char *regex;
-    int regex_len;
     mark_t *search_mark;
+    bint_t nth;
     editor_prompt(ctx->editor, is_prev ? "rsearch: Regex?" : "search: Regex?", NULL, &regex);
     if (!regex) return MLE_OK;
-    regex_len = strlen(regex);
+    bview_set_search(ctx->bview, regex);
     search_mark = buffer_add_mark(ctx->bview->buffer, NULL, 0);
+    nth = -1;
     MLE_FOREACH_CURSOR(ctx->cursor) {
-        _cmd_search_next(ctx->bview, cursor, search_mark, regex, regex_len, is_prev);
+        _cmd_search_next(ctx->bview, cursor, search_mark, is_prev, cursor == ctx->bview->active_cursor ? &nth : NULL);
     }
     mark_destroy(search_mark);
-    if (ctx->bview->last_search) free(ctx->bview->last_search);
-    ctx->bview->last_search = regex;
+    _cmd_search_show_match(ctx->bview, nth);
     return MLE_OK;
 }
 
 // Search for next instance of last search regex
 static int _cmd_search_next_ex(cmd_context_t *ctx, int is_prev) {
-    int regex_len;
     mark_t *search_mark;
+    bint_t nth;
     if (!ctx->bview->last_search) return MLE_OK;
-    regex_len = strlen(ctx->bview->last_search);
     search_mark = buffer_add_mark(ctx->bview->buffer, NULL, 0);
+    nth = -1;
     MLE_FOREACH_CURSOR(ctx->cursor) {
-        _cmd_search_next(ctx->bview, cursor, search_mark, ctx->bview->last_search, regex_len, is_prev);
+        _cmd_search_next(ctx->bview, cursor, search_mark, is_prev, cursor == ctx->bview->active_cursor ? &nth : NULL);
     }
     mark_destroy(search_mark);
+    _cmd_search_show_match(ctx->bview, nth);
     return MLE_OK;
 }
 
-// Move cursor to next occurrence of term, wrap if necessary. Return MLE_OK if
-// there was a match, or MLE_ERR if no match.
-static int _cmd_search_next(bview_t *bview, cursor_t *cursor, mark_t *search_mark, char *regex, int regex_len, int is_prev) {
+// Show match number if the search index is counted, or count it in the
+// background
+static void _cmd_search_show_match(bview_t *bview, bint_t nth) {
+    if (nth >= 0) {
+        MLE_SET_INFO(bview->editor, "search: Match %" PRIdMAX " of %" PRIdMAX, nth + 1, bview->search_index->count);
+    } else {
+        bview->count_index = bview->search_index;
+    }
+}
+
+// Move cursor to next occurrence of last search, wrap if necessary. Jump via
+// the search index once it is counted, otherwise scan from the cursor. Set
+// optret_nth to the 0-based match number if known. Return MLE_OK if there was a
+// match, or MLE_ERR if no match.
+static int _cmd_search_next(bview_t *bview, cursor_t *cursor, mark_t *search_mark, int is_prev, bint_t *optret_nth) {
     int rc;
+    char *regex;
+    int regex_len;
     int (*move_next_prev_re_nudge)(mark_t *, char *, bint_t);
     int (*move_next_prev_re)(mark_t *, char *, bint_t);
     int (*move_beginning_end)(mark_t *);
 
     rc = MLE_ERR;
+    regex = bview->last_search;
+    regex_len = strlen(regex);
+
+    if (bview->search_index->is_counted && bview->search_index->cre) {
+        // Binary search the index
+        rc = bview_match_move(bview, bview->search_index, cursor->mark, is_prev, optret_nth);
+        if (rc == MLE_OK) bview_rectify_viewport(bview);
+        return rc;
+    }
 
     // Set func pointers
     if (is_prev) {
@@ -1826,22 +1909,18 @@ static void _cmd_isearch_prompt_cb(bview_t *bview_prompt, baction_t *action, voi
 
     bview = bview_prompt->editor->active_edit;
 
-    if (bview->isearch_rule) {
-        srule_destroy(bview->isearch_rule);
-        bview->isearch_rule = NULL;
-    }
-
+    // isearch_rule is applied in bview.c
     regex = bview_prompt->buffer->first_line->data;
     regex_len = bview_prompt->buffer->first_line->data_len;
-    if (regex_len < 1) return;
-
-    // isearch_rule is applied in bview.c
-    bview->isearch_rule = srule_new_single(regex, regex_len, 1, TB_BOLD, TB_MAGENTA);
+    bview_set_isearch(bview, regex, regex_len);
     if (!bview->isearch_rule) return;
 
     mark_move_next_cre(bview->active_cursor->mark, bview->isearch_rule->cre);
 
     bview_center_viewport_y(bview);
+
+    // Count matches in the background
+    bview->count_index = bview->isearch_index;
 }
 
 // Callback from cmd_grep
@@ -2101,61 +2180,104 @@ static void _cmd_insert_auto_indent_closing_bracket(cmd_context_t *ctx) {
     if (prev_line) free(prev_line);
 }
 
-// Apply cmd for each cursor
+// Apply cmd for each cursor. Runs for all cursors go in parallel, then outputs
+// are applied bottom-up in one buffer transaction.
 static void _cmd_shell_apply_cmd(cmd_context_t *ctx, char *cmd) {
-    char *input;
+    cursor_t *cursor;
+    cursor_t **cursors;
+    char **inputs;
+    size_t *input_lens;
+    char **outputs;
+    size_t *output_lens;
+    int *exit_codes;
     bint_t input_len;
-    char *output;
-    size_t output_len;
+    int ncursors;
+    int nnonzero;
     int exit_code;
-    bline_t *block_bline;
-    bint_t block_col;
-    mark_t *block_mark;
+    int i;
 
-    // Loop for each cursor
-    MLE_FOREACH_CURSOR(ctx->cursor) {
-        // Get data to send to stdin
+    // Get data to send to stdin for each cursor in document order
+    bview_sort_cursors(ctx->bview);
+    ncursors = bview_get_active_cursor_count(ctx->bview);
+    cursors = calloc(MLE_MAX(1, ncursors), sizeof(cursor_t*));
+    inputs = calloc(MLE_MAX(1, ncursors), sizeof(char*));
+    input_lens = calloc(MLE_MAX(1, ncursors), sizeof(size_t));
+    outputs = calloc(MLE_MAX(1, ncursors), sizeof(char*));
+    output_lens = calloc(MLE_MAX(1, ncursors), sizeof(size_t));
+    exit_codes = calloc(MLE_MAX(1, ncursors), sizeof(int));
+    i = 0;
+    MLE_FOREACH_CURSOR_EX(ctx->cursor, cursor) {
+        cursors[i] = cursor;
         if (cursor->is_anchored) {
             (cursor->is_block ? mark_block_get_between : mark_get_between)
-                (cursor->mark, cursor->anchor, &input, &input_len);
-        } else {
-            input = NULL;
-            input_len = 0;
+                (cursor->mark, cursor->anchor, &inputs[i], &input_len);
+            input_lens[i] = (size_t)input_len;
         }
+        i += 1;
+    }
 
-        // Run cmd
-        output = NULL;
-        output_len = 0;
-        exit_code = -1;
-        block_mark = NULL;
-        if (util_shell_exec(ctx->editor, cmd, 1, input, input_len, 0, NULL, &output, &output_len, &exit_code) == MLE_OK) {
-            if (output_len > 0) {
-                // Write output to buffer
-                if (cursor->is_anchored) {
-                    if (cursor->is_block) {
-                        mark_block_get_top_left(cursor->mark, cursor->anchor, &block_bline, &block_col);
-                        mark_clone(cursor->mark, &block_mark);
-                        block_mark->lefty = 1;
-                        mark_move_to_w_bline(block_mark, block_bline, block_col);
-                        mark_block_delete_between(cursor->mark, cursor->anchor);
-                    } else {
-                        mark_delete_between(cursor->mark, cursor->anchor);
-                    }
-                }
-                if (cursor->is_block) {
-                    mark_block_insert_before(block_mark ? block_mark : cursor->mark, output, output_len);
-                } else {
-                    mark_insert_before(cursor->mark, output, output_len);
-                }
-            }
-            MLE_SET_INFO(ctx->editor, "shell: Exited %d", exit_code);
+    // Run cmd
+    util_shell_exec_multi(ctx->editor, cmd, 1, MLE_SHELL_MAX_PROCS, ncursors, inputs, input_lens, outputs, output_lens, exit_codes);
+
+    // Write output to buffer
+    if (ncursors > 1) buffer_begin_transaction(ctx->bview->buffer);
+    for (i = ncursors - 1; i >= 0; i--) {
+        if (exit_codes[i] >= 0 && output_lens[i] > 0) {
+            _cmd_shell_apply_output(cursors[i], outputs[i], output_lens[i]);
         }
+    }
+    if (ncursors > 1) buffer_commit_transaction(ctx->bview->buffer);
 
-        // Frees
-        if (block_mark) mark_destroy(block_mark);
-        if (input) free(input);
-        if (output) free(output);
-    } // Loop for next cursor
+    // Report exit status, or the first nonzero one with a count for many
+    exit_code = 0;
+    nnonzero = 0;
+    for (i = 0; i < ncursors; i++) {
+        if (exit_codes[i] == 0) continue;
+        if (nnonzero == 0) exit_code = exit_codes[i];
+        nnonzero += 1;
+    }
+    if (ncursors == 1 && exit_codes[0] >= 0) {
+        MLE_SET_INFO(ctx->editor, "shell: Exited %d", exit_codes[0]);
+    } else if (ncursors > 1) {
+        MLE_SET_INFO(ctx->editor, "shell: Exited %d (%d of %d nonzero)", exit_code, nnonzero, ncursors);
+    }
+
+    // Frees
+    for (i = 0; i < ncursors; i++) {
+        if (inputs[i]) free(inputs[i]);
+        if (outputs[i]) free(outputs[i]);
+    }
+    free(cursors);
+    free(inputs);
+    free(input_lens);
+    free(outputs);
+    free(output_lens);
+    free(exit_codes);
+}
+
+// Replace cursor selection with output, or insert it at cursor
+static void _cmd_shell_apply_output(cursor_t *cursor, char *output, size_t output_len) {
+    bline_t *block_bline;
+    bint_t block_col;
+    mark_t *block_mark;
+    block_mark = NULL;
+    if (cursor->is_anchored) {
+        if (cursor->is_block) {
+            mark_block_get_top_left(cursor->mark, cursor->anchor, &block_bline, &block_col);
+            mark_clone(cursor->mark, &block_mark);
+            block_mark->lefty = 1;
+            mark_move_to_w_bline(block_mark, block_bline, block_col);
+            mark_block_delete_between(cursor->mark, cursor->anchor);
+        } else {
+            mark_delete_between(cursor->mark, cursor->anchor);
+        }
+    }
+    if (cursor->is_block) {
+        mark_block_insert_before(block_mark ? block_mark : cursor->mark, output, output_len);
+    } else {
+        mark_insert_before(cursor->mark, output, output_len);
+    }
+    if (block_mark) mark_destroy(block_mark);
 }
 
 // Get one kinput_t, saving original input on cmd_context_t
@@ -2240,3 +2362,16 @@ static int _cmd_pre_close_ok_to_close_bview(editor_t *editor, bview_t *bview) {
     }
     return 0;
 }
+
+// Pad with spaces before mark up to col
+static int _cmd_align_mark(mark_t *mark, bint_t col) {
+    char *spaces;
+    bint_t nspaces;
+    if (mark->col >= col) return MLE_OK;
+    nspaces = col - mark->col;
+    spaces = malloc(nspaces);
+    memset(spaces, ' ', nspaces);
+    mark_insert_before(mark, spaces, nspaces);
+    free(spaces);
+    return MLE_OK;
+}
@@ -3,6 +3,7 @@
 #include "mle.h"
 
 static int cursor_uncut_ex(cursor_t *cursor, int editor_wide);
+static int cursor_replace_all_between(mark_t *a, mark_t *b, char *regex, char *replacement, int *inout_num_replacements);
 
 // Clone cursor
 int cursor_clone(cursor_t *cursor, int use_srules, cursor_t **ret_clone) {
@@ -284,6 +285,7 @@ int cursor_replace_ex(cursor_t *cursor, int interactive, char *opt_regex, char *
     char *replacement;
     int wrapped;
     int all;
+    int was_empty;
     char *yn;
     mark_t *lo_mark;
     mark_t *hi_mark;
@@ -311,6 +313,7 @@ int cursor_replace_ex(cursor_t *cursor, int interactive, char *opt_regex, char *
     regex = NULL;
     replacement = NULL;
     wrapped = 0;
+    was_empty = 0;
     lo_mark = NULL;
     hi_mark = NULL;
     orig_mark = NULL;
@@ -352,6 +355,25 @@ int cursor_replace_ex(cursor_t *cursor, int interactive, char *opt_regex, char *
             mark_move_end(hi_mark);
         }
         while (1) {
+            if (all) {
+                // Replace remaining matches in bulk. If an empty match was
+                // just replaced, step past it so it is not matched again.
+                if (was_empty) {
+                    mark_move_by(search_mark, 1);
+                    if (mark_is_gt(search_mark, wrapped ? orig_mark : hi_mark)) {
+                        mark_join(search_mark, wrapped ? orig_mark : hi_mark);
+                    }
+                }
+                if (!wrapped && mark_is_eq(search_mark, orig_mark)) {
+                    cursor_replace_all_between(lo_mark, hi_mark, regex, replacement, &num_replacements);
+                } else if (!wrapped) {
+                    cursor_replace_all_between(search_mark, hi_mark, regex, replacement, &num_replacements);
+                    cursor_replace_all_between(lo_mark, orig_mark, regex, replacement, &num_replacements);
+                } else {
+                    cursor_replace_all_between(search_mark, orig_mark, regex, replacement, &num_replacements);
+                }
+                break;
+            }
             pcre_rc = 0;
             // TODO compile regex
             if (mark_find_next_re(search_mark, regex, strlen(regex), &bline, &col, &char_count) == MLBUF_OK
@@ -384,9 +406,11 @@ int cursor_replace_ex(cursor_t *cursor, int interactive, char *opt_regex, char *
                     break;
                 } else if (0 == strcmp(yn, MLE_PROMPT_YES) || 0 == strcmp(yn, MLE_PROMPT_ALL)) {
                     str_append_replace_with_backrefs(&repl_backref, search_mark->bline->data, replacement, pcre_rc, pcre_ovector, 30);
+                    was_empty = 0;
                     if (mark_is_eq(search_mark, search_mark_end) && repl_backref.len <= 0) {
                         mark_move_by(search_mark, 1);
                     } else {
+                        was_empty = mark_is_eq(search_mark, search_mark_end);
                         mark_replace_between(search_mark, search_mark_end, repl_backref.data, repl_backref.len);
                         num_replacements += 1;
                     }
@@ -439,6 +463,21 @@ int cursor_replace_ex(cursor_t *cursor, int interactive, char *opt_regex, char *
     return MLE_OK;
 }
 
+// Replace all regex matches between marks in one buffer action
+static int cursor_replace_all_between(mark_t *a, mark_t *b, char *regex, char *replacement, int *inout_num_replacements) {
+    pcre2_code *cre;
+    int errcode;
+    PCRE2_SIZE erroffset;
+    bint_t num_repls;
+    cre = pcre2_compile((PCRE2_SPTR)regex, (PCRE2_SIZE)strlen(regex), PCRE2_CASELESS, &errcode, &erroffset, NULL);
+    if (!cre) return MLE_ERR;
+    num_repls = 0;
+    mark_replace_all_cre_between(a, b, cre, replacement, &num_repls);
+    *inout_num_replacements += (int)num_repls;
+    pcre2_code_free(cre);
+    return MLE_OK;
+}
+
 // Uncut (paste) text
 static int cursor_uncut_ex(cursor_t *cursor, int editor_wide) {
     char *cut_buffer;
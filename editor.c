@@ -42,6 +42,12 @@ static void _editor_resize(editor_t *editor, int w, int h);
 static void _editor_maybe_lift_temp_anchors(cmd_context_t *ctx);
 static void _editor_draw_cursors(editor_t *editor, bview_t *bview);
 static void _editor_get_user_input(editor_t *editor, cmd_context_t *ctx);
+static int _editor_get_event(editor_t *editor, tb_event_t *ev, int timeout_ms);
+static int _editor_should_display(editor_t *editor);
+static int _editor_has_pending_event(editor_t *editor);
+static int _editor_is_applying_macro(editor_t *editor);
+static int _editor_count_matches(editor_t *editor);
+static void _editor_display_status(editor_t *editor);
 static void _editor_ingest_paste(editor_t *editor, cmd_context_t *ctx);
 static void _editor_handle_mouse(editor_t *editor, tb_event_t *ev);
 static void _editor_append_pastebuf(editor_t *editor, cmd_context_t *ctx, kinput_t *input);
@@ -105,6 +111,9 @@ int editor_init(editor_t *editor, int argc, char **argv) {
         editor->read_rc_file = MLE_DEFAULT_READ_RC_FILE;
         editor->soft_wrap = MLE_DEFAULT_SOFT_WRAP;
         editor->coarse_undo = MLE_DEFAULT_COARSE_UNDO;
+        editor->undo_max_kb = MLE_DEFAULT_UNDO_MAX_KB;
+        editor->undo_journal_kb = MLE_DEFAULT_UNDO_JOURNAL_KB;
+        editor->max_fps = MLE_DEFAULT_MAX_FPS;
         editor->viewport_scope_x = -4;
         editor->viewport_scope_y = -1;
         editor->color_col = -1;
@@ -248,7 +257,7 @@ int editor_deinit(editor_t *editor) {
     if (editor->kmap_init_name) free(editor->kmap_init_name);
     if (editor->insertbuf) free(editor->insertbuf);
     if (editor->cut_buffer) free(editor->cut_buffer);
-    if (editor->ttyfd) close(editor->ttyfd);
+    if (editor->ttyfd > 0) close(editor->ttyfd);
     if (editor->startup_macro_name) free(editor->startup_macro_name);
     if (editor->macro_last) free(editor->macro_last);
 
@@ -439,6 +448,8 @@ int editor_debug_dump(editor_t *editor, FILE *fp) {
     buffer_t *buffer;
     bline_t *bline;
     bint_t c;
+    bint_t count;
+    int is_done;
     int bview_index;
     int cursor_index;
     bview_index = 0;
@@ -456,9 +467,13 @@ int editor_debug_dump(editor_t *editor, FILE *fp) {
             cursor_index += 1;
         }
         fprintf(fp, "bview.%d.cursor_count=%d\n", bview_index, cursor_index);
+        // Finish a count cut short by input or a macro
+        bview_match_count(bview, bview->search_index, INTMAX_MAX, &count, &is_done);
+        fprintf(fp, "bview.%d.search_count=%" PRIdMAX "\n", bview_index, count);
         buffer = bview->buffer;
         fprintf(fp, "bview.%d.buffer.byte_count=%" PRIdMAX "\n", bview_index, buffer->byte_count);
         fprintf(fp, "bview.%d.buffer.line_count=%" PRIdMAX "\n", bview_index, buffer->line_count);
+        fprintf(fp, "bview.%d.buffer.undo_bytes=%" PRIdMAX "\n", bview_index, buffer->undo_bytes);
         fprintf(fp, "bview.%d.buffer.path=%s\n", bview_index, buffer->path ? buffer->path : "");
         for (bline = buffer->first_line; bline != NULL; bline = bline->next) {
             MLBUF_BLINE_ENSURE_CHARS(bline);
@@ -479,6 +494,9 @@ int editor_debug_dump(editor_t *editor, FILE *fp) {
         bview_index += 1;
     }
     fprintf(fp, "bview_count=%d\n", bview_index);
+    fprintf(fp, "display.frames=%zu\n", editor->display_frames);
+    fprintf(fp, "display.bytes_last=%zu\n", editor->display_bytes_last);
+    fprintf(fp, "display.bytes_total=%zu\n", editor->display_bytes_total);
     return MLE_OK;
 }
 
@@ -542,6 +560,21 @@ int editor_register_cmd(editor_t *editor, cmd_t *cmd) {
     return MLE_OK;
 }
 
+// Start a new undo action group for a user cmd unless func continues a run of
+// typing or deleting. The run then shares one group, so with coarse undo its
+// edits coalesce into one undo action.
+int editor_start_action_group(editor_t *editor, cmd_func_t func) {
+    if (!func || func != editor->action_group_func) {
+        editor->action_group += 1;
+    }
+    if (func == cmd_insert_data || func == cmd_delete_before || func == cmd_delete_after) {
+        editor->action_group_func = func;
+    } else {
+        editor->action_group_func = NULL;
+    }
+    return MLE_OK;
+}
+
 // Get input from either macro or user
 int editor_get_input(editor_t *editor, loop_context_t *loop_ctx, cmd_context_t *ctx) {
     ctx->is_user_input = 0;
@@ -581,7 +614,18 @@ int editor_get_input(editor_t *editor, loop_context_t *loop_ctx, cmd_context_t *
 int editor_display(editor_t *editor) {
     bview_t *bview;
     if (editor->headless_mode) return MLE_OK;
-    tb_clear();
+    if (editor->is_display_dirty
+        || editor->display_root != editor->active_edit_root
+        || editor->debug_display_keys
+    ) {
+        // Repaint everything. Otherwise edit bviews only redraw changed rows.
+        editor->is_display_dirty = 1;
+        editor->display_root = editor->active_edit_root;
+        tb_clear();
+    } else {
+        tb_clear_rect(editor->rect_status.x, editor->rect_status.y, editor->rect_status.w, editor->rect_status.h);
+        tb_clear_rect(editor->rect_prompt.x, editor->rect_prompt.y, editor->rect_prompt.w, editor->rect_prompt.h);
+    }
     bview_draw(editor->active_edit_root);
     bview_draw(editor->status);
     if (editor->prompt) bview_draw(editor->prompt);
@@ -590,6 +634,11 @@ int editor_display(editor_t *editor) {
     }
     if (editor->debug_display_keys) _editor_display_keys(editor);
     tb_present();
+    gettimeofday(&editor->display_time, NULL);
+    editor->is_display_dirty = 0;
+    editor->display_frames += 1;
+    editor->display_bytes_last = tb_last_present_bytes();
+    editor->display_bytes_total += editor->display_bytes_last;
     return MLE_OK;
 }
 
@@ -912,7 +961,7 @@ static void _editor_loop(editor_t *editor, loop_context_t *loop_ctx) {
         editor->loop_ctx = loop_ctx;
 
         // Display editor
-        if (!editor->is_display_disabled) {
+        if (!editor->is_display_disabled && _editor_should_display(editor)) {
             editor_display(editor);
         }
 
@@ -921,9 +970,17 @@ static void _editor_loop(editor_t *editor, loop_context_t *loop_ctx) {
             break;
         }
 
+        // Count search matches a slice at a time until there is input. Only
+        // the status bar changes in between. Macros replay without counting.
+        if (!_editor_is_applying_macro(editor)) {
+            while (!_editor_has_pending_event(editor) && _editor_count_matches(editor)) {
+                if (!editor->is_display_disabled) _editor_display_status(editor);
+            }
+        }
+
         // Check for async io
         // aproc_drain_all will bail and return 0 if there's any tty data
-        if (editor->aprocs && aproc_drain_all(editor->aprocs, &editor->ttyfd)) {
+        if (editor->aprocs && !editor->has_pending_ev && aproc_drain_all(editor->aprocs, &editor->ttyfd)) {
             continue;
         }
 
@@ -949,9 +1006,15 @@ static void _editor_loop(editor_t *editor, loop_context_t *loop_ctx) {
                 memcpy(&cmd_ctx, &loop_ctx->last_cmd_ctx, sizeof(cmd_ctx));
             }
 
+            // Start a new undo action group per user cmd
+            if (cmd_ctx.is_user_input) editor_start_action_group(editor, cmd_ctx.cmd->func);
+
             // Notify cmd:*:before observers
             _editor_notify_cmd_observers(&cmd_ctx, 1);
 
+            // Keep cursors in document order if observers added any
+            bview_sort_cursors(editor->active);
+
             // Refresh cmd ctx if observers changed anything
             _editor_refresh_cmd_context(editor, &cmd_ctx);
 
@@ -961,6 +1024,9 @@ static void _editor_loop(editor_t *editor, loop_context_t *loop_ctx) {
             // Lift any temp anchors
             _editor_maybe_lift_temp_anchors(&cmd_ctx);
 
+            // Keep cursors in document order
+            bview_sort_cursors(editor->active);
+
             // Notify cmd:*:after observers
             _editor_notify_cmd_observers(&cmd_ctx, 0);
 
@@ -1062,7 +1128,7 @@ int editor_force_redraw(editor_t *editor) {
     int h;
     int x;
     int y;
-    (void)editor;
+    editor->is_display_dirty = 1;
     if (tb_width() >= 0) tb_shutdown();
     tb_init();
     editor_set_input_mode(editor);
@@ -1127,6 +1193,7 @@ static void _editor_resize(editor_t *editor, int w, int h) {
 
     editor->w = w >= 0 ? w : tb_width();
     editor->h = h >= 0 ? h : tb_height();
+    editor->is_display_dirty = 1;
 
     editor->rect_edit.x = 0;
     editor->rect_edit.y = 0;
@@ -1239,7 +1306,7 @@ static void _editor_get_user_input(editor_t *editor, cmd_context_t *ctx) {
 
     // Poll for event
     while (1) {
-        rc = tb_poll_event(&ev);
+        rc = _editor_get_event(editor, &ev, -1);
         if (rc != TB_OK) {
             continue; // Error
         } else if (ev.type == TB_EVENT_RESIZE) {
@@ -1249,16 +1316,86 @@ static void _editor_get_user_input(editor_t *editor, cmd_context_t *ctx) {
             continue;
         } else if (ev.type == TB_EVENT_MOUSE) {
             // Mouse cursor
+            editor_start_action_group(editor, NULL); // Moving the cursor ends a typing run
             _editor_handle_mouse(editor, &ev);
             editor_display(editor);
             continue;
         }
         MLE_KINPUT_SET(ctx->input, ev.mod, ev.ch, ev.key);
-        editor->user_input_count += 1;
         break;
     }
 }
 
+// Get read-ahead event if any, else wait up to timeout_ms (-1 for no limit)
+static int _editor_get_event(editor_t *editor, tb_event_t *ev, int timeout_ms) {
+    if (editor->has_pending_ev) {
+        memcpy(ev, &editor->pending_ev, sizeof(tb_event_t));
+        editor->has_pending_ev = 0;
+        return TB_OK;
+    }
+    return timeout_ms < 0 ? tb_poll_event(ev) : tb_peek_event(ev, timeout_ms);
+}
+
+// Count a slice of the matches shown in the status bar. Return 1 if counting.
+static int _editor_count_matches(editor_t *editor) {
+    bview_t *bview;
+    bint_t count;
+    int is_done;
+    bview = editor->active_edit;
+    if (!bview || !bview->count_index || !bview->count_index->cre) return 0;
+    bview_match_count(bview, bview->count_index, MLE_MATCH_COUNT_SLICE_BYTES, &count, &is_done);
+    MLE_SET_INFO(editor, "%s: %" PRIdMAX "%s match(es)",
+        bview->count_index == bview->isearch_index ? "isearch" : "search",
+        count, is_done ? "" : "+");
+    if (is_done) bview->count_index = NULL;
+    return 1;
+}
+
+// Redraw only the status bar
+static void _editor_display_status(editor_t *editor) {
+    if (editor->headless_mode) return;
+    tb_clear_rect(editor->rect_status.x, editor->rect_status.y, editor->rect_status.w, editor->rect_status.h);
+    bview_draw(editor->status);
+    tb_present();
+}
+
+// Return 1 if a frame should be drawn before handling the next input
+static int _editor_should_display(editor_t *editor) {
+    struct timeval now;
+    long elapsed_us;
+
+    if (editor->headless_mode) {
+        return 1;
+    } else if (_editor_is_applying_macro(editor)) {
+        // Draw once when the macro is done
+        return 0;
+    }
+
+    // Draw right away if no input is queued, e.g., after a key press
+    if (!_editor_has_pending_event(editor) || editor->max_fps <= 0) {
+        return 1;
+    }
+
+    // Input is queued, e.g., key repeat or a burst over ssh. Handle it first
+    // but still draw at max_fps so progress is visible.
+    gettimeofday(&now, NULL);
+    elapsed_us = (now.tv_sec - editor->display_time.tv_sec) * 1000000L + (now.tv_usec - editor->display_time.tv_usec);
+    return elapsed_us >= 1000000L / editor->max_fps ? 1 : 0;
+}
+
+// Return 1 if input is queued, reading it ahead into pending_ev
+static int _editor_has_pending_event(editor_t *editor) {
+    if (!editor->has_pending_ev && !editor->headless_mode && tb_peek_event(&editor->pending_ev, 0) == TB_OK) {
+        editor->has_pending_ev = 1;
+    }
+    return editor->has_pending_ev;
+}
+
+// Return 1 if a macro is replaying inputs
+static int _editor_is_applying_macro(editor_t *editor) {
+    return editor->macro_apply && editor->macro_apply_input_index < editor->macro_apply->inputs_len ? 1 : 0;
+}
+
 // Ingest available input until non-cmd_insert_data
 static void _editor_ingest_paste(editor_t *editor, cmd_context_t *ctx) {
     int rc;
@@ -1268,7 +1405,7 @@ static void _editor_ingest_paste(editor_t *editor, cmd_context_t *ctx) {
 
     while (1) {
         // Peek event
-        rc = tb_peek_event(&ev, 0);
+        rc = _editor_get_event(editor, &ev, 0);
         if (rc != TB_OK) {
             break; // Error
         } else if (ev.type == TB_EVENT_RESIZE) {
@@ -1748,6 +1885,7 @@ static void _editor_register_cmds(editor_t *editor) {
     _editor_register_cmd_fn(editor, "cmd_quit", cmd_quit);
     _editor_register_cmd_fn(editor, "cmd_quit_without_saving", cmd_quit_without_saving);
     _editor_register_cmd_fn(editor, "cmd_redo", cmd_redo);
+    _editor_register_cmd_fn(editor, "cmd_redo_branch", cmd_redo_branch);
     _editor_register_cmd_fn(editor, "cmd_redraw", cmd_redraw);
     _editor_register_cmd_fn(editor, "cmd_remove_extra_cursors", cmd_remove_extra_cursors);
     _editor_register_cmd_fn(editor, "cmd_repeat", cmd_repeat);
@@ -1772,6 +1910,8 @@ static void _editor_register_cmds(editor_t *editor) {
     _editor_register_cmd_fn(editor, "cmd_uncut", cmd_uncut);
     _editor_register_cmd_fn(editor, "cmd_uncut_last", cmd_uncut_last);
     _editor_register_cmd_fn(editor, "cmd_undo", cmd_undo);
+    _editor_register_cmd_fn(editor, "cmd_undo_earlier", cmd_undo_earlier);
+    _editor_register_cmd_fn(editor, "cmd_undo_later", cmd_undo_later);
     _editor_register_cmd_fn(editor, "cmd_viewport_bot", cmd_viewport_bot);
     _editor_register_cmd_fn(editor, "cmd_viewport_mid", cmd_viewport_mid);
     _editor_register_cmd_fn(editor, "cmd_viewport_toggle", cmd_viewport_toggle);
@@ -1925,6 +2065,9 @@ static void _editor_init_kmaps(editor_t *editor) {
         MLE_KBINDING_DEF("cmd_blist", "C-\\"),
         MLE_KBINDING_DEF("cmd_undo", "C-z"),
         MLE_KBINDING_DEF("cmd_redo", "C-y"),
+        MLE_KBINDING_DEF("cmd_redo_branch", "M-Y"),
+        MLE_KBINDING_DEF("cmd_undo_earlier", "M-U"),
+        MLE_KBINDING_DEF("cmd_undo_later", "M-R"),
         MLE_KBINDING_DEF("cmd_save", "C-s"),
         MLE_KBINDING_DEF("cmd_save_as", "M-s"),
         MLE_KBINDING_DEF_EX("cmd_set_opt", "M-o a", "tab_to_space"),
@@ -2428,7 +2571,7 @@ static int _editor_init_from_args(editor_t *editor, int argc, char **argv) {
     cur_kmap = NULL;
     cur_syntax = NULL;
     optind = 1;
-    #define MLE_GETOPT_STR "ha:b:c:e:H:i:K:k:l:M:m:Nn:p:S:s:t:u:vw:x:y:z:Q:"
+    #define MLE_GETOPT_STR "ha:b:c:e:f:H:i:j:K:k:l:M:m:Nn:p:S:s:t:u:U:vw:x:y:z:Q:"
     while (rv == MLE_OK && (c = getopt(argc, argv, MLE_GETOPT_STR)) != -1) {
         switch (c) {
             case 'h':
@@ -2439,8 +2582,10 @@ static int _editor_init_from_args(editor_t *editor, int argc, char **argv) {
                 printf("    -b <1|0>     Enable/disable highlight bracket pairs (default: %d)\n", MLE_DEFAULT_HILI_BRACKET_PAIRS);
                 printf("    -c <column>  Set color column (default: -1, disabled)\n");
                 printf("    -e <1|0>     Enable/disable mouse support (default: %d)\n", MLE_DEFAULT_MOUSE_SUPPORT);
+                printf("    -f <fps>     Set max redraws per second while input is queued (default: %d, 0=no limit)\n", MLE_DEFAULT_MAX_FPS);
                 printf("    -H <1|0>     Enable/disable headless mode (default: 1 if no tty, else 0)\n");
                 printf("    -i <1|0>     Enable/disable auto indent (default: %d)\n", MLE_DEFAULT_AUTO_INDENT);
+                printf("    -j <kb>      Spill undo data of at least this size to a temp file (default: %d, 0=never)\n", MLE_DEFAULT_UNDO_JOURNAL_KB);
                 printf("    -K <kdef>    Make a kmap definition (use with -k)\n");
                 printf("    -k <kbind>   Add key binding to current kmap definition (use after -K)\n");
                 printf("    -l <ltype>   Set linenum type (default: 0, absolute)\n");
@@ -2453,6 +2598,7 @@ static int _editor_init_from_args(editor_t *editor, int argc, char **argv) {
                 printf("    -s <synrule> Add syntax rule to current syntax definition (use after -S)\n");
                 printf("    -t <size>    Set tab size (default: %d)\n", MLE_DEFAULT_TAB_WIDTH);
                 printf("    -u <1|0>     Enable/disable coarse undo/redo (default: %d)\n", MLE_DEFAULT_COARSE_UNDO);
+                printf("    -U <kb>      Set max undo memory per buffer (default: %d, 0=no limit)\n", MLE_DEFAULT_UNDO_MAX_KB);
                 printf("    -v           Print version and exit\n");
                 printf("    -w <1|0>     Enable/disable soft word wrap (default: %d)\n", MLE_DEFAULT_SOFT_WRAP);
                 printf("    -x <uscript> Run a Lua user script\n");
@@ -2484,12 +2630,18 @@ static int _editor_init_from_args(editor_t *editor, int argc, char **argv) {
             case 'e':
                 editor->mouse_support = atoi(optarg) ? 1 : 0;
                 break;
+            case 'f':
+                editor->max_fps = atoi(optarg);
+                break;
             case 'H':
                 editor->headless_mode = atoi(optarg) ? 1 : 0;
                 break;
             case 'i':
                 editor->auto_indent = atoi(optarg) ? 1 : 0;
                 break;
+            case 'j':
+                editor->undo_journal_kb = MLE_MAX(0, atoi(optarg));
+                break;
             case 'K':
                 if (_editor_init_kmap_by_str(editor, &cur_kmap, optarg) != MLE_OK) {
                     MLE_LOG_ERR("Could not init kmap by str: %s\n", optarg);
@@ -2553,6 +2705,9 @@ static int _editor_init_from_args(editor_t *editor, int argc, char **argv) {
             case 'u':
                 editor->coarse_undo = atoi(optarg);
                 break;
+            case 'U':
+                editor->undo_max_kb = MLE_MAX(0, atoi(optarg));
+                break;
             case 'v':
                 printf("mle version %s\n", MLE_VERSION);
                 rv = MLE_ERR;
@@ -18,6 +18,7 @@ pcre2_match_data *pcre2_md = NULL;
 static PCRE2_SIZE *pcre_ovector = NULL;
 static int pcre_ovector_size = 0;
 static int *pcre_rc = NULL;
+static bline_brackets_t *_mark_get_bline_brackets(bline_t *bline);
 static char bracket_pairs[8] = {
     '[', ']',
     '(', ')',
@@ -79,6 +80,13 @@ int mark_replace_between(mark_t *self, mark_t *other, char *data, bint_t data_le
     return bline_replace(a->bline, a->col, nchars, data, data_len);
 }
 
+// Replace all matches of cre between self and other
+int mark_replace_all_cre_between(mark_t *self, mark_t *other, pcre2_code *cre, char *repl, bint_t *optret_num_repls) {
+    mark_t *a, *b;
+    mark_cmp(self, other, &a, &b);
+    return buffer_replace_all_cre(a->bline->buffer, a->bline, a->col, b->bline, b->col, cre, repl, optret_num_repls);
+}
+
 // Move mark to bline:col
 int mark_move_to_w_bline(mark_t *self, bline_t *bline, bint_t col) {
     _mark_mark_move_inner(self, bline, col, 1);
@@ -95,9 +103,26 @@ int mark_move_to(mark_t *self, bint_t line_index, bint_t col) {
 
 // Move mark by a character delta
 int mark_move_by(mark_t *self, bint_t char_delta) {
-    bint_t offset;
-    buffer_get_offset(self->bline->buffer, self->bline, self->col, &offset);
-    return mark_move_offset(self, offset + char_delta);
+    bline_t *bline;
+    bint_t col;
+    // Walk lines from the mark instead of going through a buffer offset, which
+    // would walk from the first line
+    bline = self->bline;
+    col = self->col + char_delta;
+    while (col < 0 && bline->prev) {
+        bline = bline->prev;
+        MLBUF_BLINE_ENSURE_CHARS(bline);
+        col += bline->char_count + 1; // Plus 1 for newline
+    }
+    MLBUF_BLINE_ENSURE_CHARS(bline);
+    while (col > bline->char_count && bline->next) {
+        col -= bline->char_count + 1;
+        bline = bline->next;
+        MLBUF_BLINE_ENSURE_CHARS(bline);
+    }
+    col = MLBUF_MAX(0, MLBUF_MIN(col, bline->char_count));
+    _mark_mark_move_inner(self, bline, col, 1);
+    return MLBUF_OK;
 }
 
 // Get mark offset
@@ -288,10 +313,14 @@ int mark_find_bracket_pair(mark_t *self, bint_t max_chars, bline_t **ret_line, b
     char cur;
     int dir;
     int i;
-    int nest;
+    bint_t nest;
+    bint_t delta;
+    bint_t min_depth;
     bint_t col;
     bint_t nchars;
     bline_t *cur_line;
+    bline_brackets_t *brackets;
+    int is_code;
     MLBUF_BLINE_ENSURE_CHARS(self->bline);
 
     // If we're at eol, there's nothing to match
@@ -318,6 +347,9 @@ int mark_find_bracket_pair(mark_t *self, bint_t max_chars, bline_t **ret_line, b
     if (!targ) {
         return MLBUF_ERR;
     }
+    // Skip brackets in strings and comments, unless brkt is in one. Then
+    // match it as plain text.
+    is_code = !self->bline->chars[self->col].is_in_srule;
     // Now look for targ, keeping track of nesting
     // Break if we look at more than max_chars
     nest = -1;
@@ -326,8 +358,22 @@ int mark_find_bracket_pair(mark_t *self, bint_t max_chars, bline_t **ret_line, b
     nchars = 0;
     while (cur_line) {
         MLBUF_BLINE_ENSURE_CHARS(cur_line);
+        if (is_code && cur_line != self->bline && nchars + cur_line->char_count < max_chars) {
+            // Skip whole lines whose brackets cannot bring nesting back to
+            // the level of targ. Scanning backward, the lowest depth of any
+            // suffix is the lowest prefix depth less the net delta.
+            brackets = _mark_get_bline_brackets(cur_line);
+            delta = brackets->delta[i / 2] * dir;
+            min_depth = dir > 0 ? brackets->min_depth[i / 2] : brackets->min_depth[i / 2] - brackets->delta[i / 2];
+            if (nest + 1 + min_depth > 0) {
+                nest += delta;
+                nchars += cur_line->char_count;
+                col = -1;
+            }
+        }
         for (; col >= 0 && col < cur_line->char_count; col += dir) {
             cur = *(cur_line->data + cur_line->chars[col].index);
+            if (is_code && cur_line->chars[col].is_in_srule) cur = 0;
             if (cur == targ) {
                 if (nest == 0) {
                     // Match!
@@ -358,6 +404,36 @@ int mark_find_bracket_pair(mark_t *self, bint_t max_chars, bline_t **ret_line, b
     return MLBUF_ERR;
 }
 
+// Return bracket depth summary of bline, counting it again if stale. Brackets
+// in strings and comments are not counted.
+static bline_brackets_t *_mark_get_bline_brackets(bline_t *bline) {
+    bline_brackets_t *brackets;
+    bint_t col;
+    int i;
+    char cur;
+    MLBUF_BLINE_ENSURE_CHARS(bline);
+    if (!bline->brackets) {
+        bline->brackets = calloc(1, sizeof(bline_brackets_t));
+    } else if (bline->brackets->version == bline->version && bline->brackets->style_version == bline->style_version) {
+        return bline->brackets;
+    }
+    brackets = bline->brackets;
+    memset(brackets, 0, sizeof(bline_brackets_t));
+    brackets->version = bline->version;
+    brackets->style_version = bline->style_version;
+    for (col = 0; col < bline->char_count; col++) {
+        if (bline->chars[col].is_in_srule) continue;
+        cur = *(bline->data + bline->chars[col].index);
+        for (i = 0; i < MLBUF_BRACKET_PAIR_TYPES * 2; i++) {
+            if (bracket_pairs[i] != cur) continue;
+            brackets->delta[i / 2] += i % 2 == 0 ? 1 : -1;
+            brackets->min_depth[i / 2] = MLBUF_MIN(brackets->min_depth[i / 2], brackets->delta[i / 2]);
+            break;
+        }
+    }
+    return brackets;
+}
+
 // Delete data between self and other
 int mark_delete_between(mark_t *self, mark_t *other) {
     bint_t nchars;
@@ -840,6 +916,7 @@ static int mark_find_match(mark_t *self, mark_find_match_fn matchfn, void *u1, v
 // Move mark to target:col, setting target_col if do_set_target is truthy
 void _mark_mark_move_inner(mark_t *mark, bline_t *bline_target, bint_t col, int do_set_target) {
     int is_changing_line;
+    mark_t *hint;
     is_changing_line = mark->bline != bline_target ? 1 : 0;
     if (is_changing_line) {
         DL_DELETE(mark->bline->marks, mark);
@@ -851,7 +928,32 @@ void _mark_mark_move_inner(mark_t *mark, bline_t *bline_target, bint_t col, int
         mark->target_col = mark->col;
     }
     if (is_changing_line) {
-        DL_APPEND(bline_target->marks, mark);
+        _mark_mark_link(mark, NULL);
+    } else if ((mark != mark->bline->marks && mark->prev->col > mark->col)
+        || (mark->next && mark->next->col < mark->col)
+    ) {
+        // Out of order, relink starting from a neighbor
+        hint = mark != mark->bline->marks ? mark->prev : mark->next;
+        DL_DELETE(mark->bline->marks, mark);
+        _mark_mark_link(mark, hint);
+    }
+}
+
+// Link mark into mark->bline->marks, which is kept sorted by col. The search
+// starts at opt_hint if set, otherwise at the tail.
+void _mark_mark_link(mark_t *mark, mark_t *opt_hint) {
+    mark_t **marks;
+    mark_t *el;
+    marks = &mark->bline->marks;
+    el = opt_hint ? opt_hint : (*marks ? (*marks)->prev : NULL);
+    while (el && el->col > mark->col) {
+        el = el != *marks ? el->prev : NULL;
+    }
+    if (el) {
+        while (el->next && el->next->col <= mark->col) el = el->next;
+        DL_APPEND_ELEM(*marks, el, mark);
+    } else {
+        DL_PREPEND(*marks, mark);
     }
 }
 
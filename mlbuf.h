@@ -13,14 +13,18 @@
 typedef struct buffer_s buffer_t; // A buffer of text (stored as a linked list of blines)
 typedef struct bline_s bline_t; // A line in a buffer
 typedef struct bline_char_s bline_char_t; // Metadata about a character in a bline
-typedef struct baction_s baction_t; // An insert or delete action (used for undo)
+typedef struct bline_brackets_s bline_brackets_t; // Bracket depth summary of a bline
+typedef struct baction_s baction_t; // An insert, delete, or replace action (used for undo)
+typedef struct baction_branch_s baction_branch_t; // Undone actions set aside by a later edit (undo tree)
 typedef struct mark_s mark_t; // A mark in a buffer
 typedef struct srule_s srule_t; // A style rule
 typedef struct srule_node_s srule_node_t; // A node in a list of style rules
+typedef struct srule_span_s srule_span_t; // Columns of a line covered by a range style rule
 typedef struct sblock_s sblock_t; // A style of a particular character
 typedef struct smemo_s smemo_t; // A memoization of pcre2_match
 typedef struct str_s str_t; // A dynamically resizeable string
-typedef void (*buffer_callback_t)(buffer_t *buffer, baction_t *action, void *udata);
+typedef struct pool_s pool_t; // A free list of fixed-size objects allocated in slabs
+typedef void (*buffer_callback_t)(buffer_t *buffer, baction_t *action, void *udata); // action is NULL on buffer_commit_transaction
 typedef intmax_t bint_t;
 
 // str_t
@@ -31,17 +35,36 @@ struct str_s {
     ssize_t inc;
 };
 
+// pool_t
+struct pool_s {
+    size_t obj_size;
+    size_t slab_nobjs;
+    void *slabs;
+    void *free_objs;
+};
+
 // buffer_t
 struct buffer_s {
     bline_t *first_line;
     bline_t *last_line;
     bint_t byte_count;
     bint_t line_count;
+    bint_t version; // Changes whenever a bline changes, is added or is freed
     srule_node_t *srules;
     srule_node_t *range_srules;
     baction_t *actions;
     baction_t *action_tail;
     baction_t *action_undone;
+    baction_branch_t *undo_branches; // Undo tree branches off of actions, oldest first
+    baction_branch_t *root_branches; // Undo tree branches at the start of history
+    baction_t *actions_by_time; // Every recorded action, including branches, oldest first
+    bint_t action_seq; // Sequence number of the last recorded action
+    bint_t undo_bytes; // Memory held by actions, including branches
+    bint_t undo_max_bytes; // Drop oldest actions past this, 0 for no limit
+    int is_undo_coalesced; // Fold adjacent actions of the same action group
+    int undo_journal_fd; // Append-only file of spilled action payloads, -1 if off
+    bint_t undo_journal_len;
+    bint_t undo_journal_min_bytes; // Spill payloads at least this big
     str_t registers[26];
     mark_t *lettered_marks[26];
     char *path;
@@ -59,11 +82,16 @@ struct buffer_s {
     size_t mmap_len;
     bline_char_t *slabbed_chars;
     bline_t *slabbed_blines;
+    pool_t bline_pool;
+    pool_t mark_pool;
+    pool_t baction_pool;
     int *action_group;
     int num_applied_srules;
     int is_in_open;
     int is_in_callback;
     int is_style_disabled;
+    int transaction_depth; // Nesting level of buffer_begin_transaction
+    bline_t *transaction_line; // Topmost line edited in the transaction, lines after may be misnumbered
     int is_in_undo;
     int last_errno;
 };
@@ -75,12 +103,15 @@ struct bline_s {
     bint_t data_len;
     bint_t data_cap;
     bint_t line_index;
+    bint_t version; // Changes whenever data changes
+    bint_t style_version; // Changes whenever styles are reapplied
     bint_t char_count;
     bint_t char_vwidth;
     bline_char_t *chars;
     bint_t chars_cap;
-    mark_t *marks;
+    mark_t *marks; // Sorted by col
     srule_t *eol_rule;
+    bline_brackets_t *brackets;
     int is_chars_dirty;
     int is_slabbed;
     int is_data_slabbed;
@@ -102,6 +133,7 @@ struct bline_char_s {
     bint_t vcol;
     bint_t index_to_vcol; // accessed via >chars[index], not >chars[char]
     sblock_t style;
+    int is_in_srule; // Inside a syntax srule match past its first char, e.g., in a string or comment
 };
 
 // baction_t
@@ -120,8 +152,28 @@ struct baction_s {
     int action_group;
     char *data;
     bint_t data_len;
+    char *del_data; // MLBUF_BACTION_TYPE_REPLACE only
+    bint_t del_data_len;
+    bint_t del_nchars;
+    int is_journaled; // data and del_data were moved to the undo journal
+    bint_t journal_offset; // Offset of data, followed by del_data
+    bint_t seq; // Order in which the action was recorded
+    baction_branch_t *branches; // Undo tree branches that follow this action, oldest first
+    baction_branch_t *branch; // Branch that starts with this action, if any
     baction_t *next;
     baction_t *prev;
+    baction_t *time_next;
+    baction_t *time_prev;
+};
+
+// baction_branch_t
+struct baction_branch_s {
+    baction_t *actions;
+    baction_t *parent; // Action the branch follows, NULL if at start of history
+    baction_branch_t *next;
+    baction_branch_t *prev;
+    baction_branch_t *sibling_next; // Next branch that follows parent
+    baction_branch_t *sibling_prev;
 };
 
 // mark_t
@@ -166,6 +218,14 @@ struct srule_node_s {
     srule_node_t *prev;
 };
 
+// srule_span_t
+struct srule_span_s {
+    srule_t *srule;
+    bint_t start_col;
+    bint_t end_col; // Exclusive, or -1 for end of line
+    int next; // Index of next span on the same line, or -1
+};
+
 // buffer functions
 buffer_t *buffer_new(void);
 buffer_t *buffer_new_open(char *path, int *optret_errno);
@@ -189,6 +249,7 @@ int buffer_replace(buffer_t *self, bint_t offset, bint_t num_chars, char *data,
 int buffer_insert_w_bline(buffer_t *self, bline_t *start_line, bint_t start_col, char *data, bint_t data_len, bint_t *optret_num_chars);
 int buffer_delete_w_bline(buffer_t *self, bline_t *start_line, bint_t start_col, bint_t num_chars);
 int buffer_replace_w_bline(buffer_t *self, bline_t *start_line, bint_t start_col, bint_t num_chars, char *data, bint_t data_len);
+int buffer_replace_all_cre(buffer_t *self, bline_t *start_line, bint_t start_col, bline_t *end_line, bint_t end_col, pcre2_code *cre, char *repl, bint_t *optret_num_repls);
 int buffer_get_bline(buffer_t *self, bint_t line_index, bline_t **ret_bline);
 int buffer_get_bline_w_hint(buffer_t *self, bint_t line_index, bline_t *opt_hint, bline_t **ret_bline);
 int buffer_get_bline_col(buffer_t *self, bint_t offset, bline_t **ret_bline, bint_t *ret_col);
@@ -197,11 +258,20 @@ int buffer_undo(buffer_t *self);
 int buffer_redo(buffer_t *self);
 int buffer_undo_action_group(buffer_t *self);
 int buffer_redo_action_group(buffer_t *self);
+int buffer_switch_undo_branch(buffer_t *self);
+int buffer_undo_earlier(buffer_t *self, int by_group);
+int buffer_undo_later(buffer_t *self, int by_group);
+int buffer_begin_transaction(buffer_t *self); // Defers renumbering only; styles and callback run per action
+int buffer_commit_transaction(buffer_t *self);
 int buffer_add_srule(buffer_t *self, srule_t *srule);
 int buffer_remove_srule(buffer_t *self, srule_t *srule);
+int buffer_get_range_spans(buffer_t *self, bint_t line_index, bint_t nlines, int is_block, srule_span_t **ret_spans, int **ret_heads);
 int buffer_set_callback(buffer_t *self, buffer_callback_t fn_cb, void *udata);
 int buffer_set_action_group_ptr(buffer_t *self, int *action_group);
 int buffer_set_tab_width(buffer_t *self, int tab_width);
+int buffer_set_undo_max_bytes(buffer_t *self, bint_t undo_max_bytes);
+int buffer_set_undo_coalesced(buffer_t *self, int is_coalesced);
+int buffer_set_undo_journal(buffer_t *self, char *opt_path, bint_t min_bytes);
 int buffer_set_styles_enabled(buffer_t *self, int is_enabled);
 int buffer_apply_styles(buffer_t *self, bline_t *start_line, bint_t line_delta);
 int buffer_register_set(buffer_t *self, char reg, char *data, size_t data_len);
@@ -288,6 +358,7 @@ int mark_move_prev_str(mark_t *self, char *str, bint_t str_len);
 int mark_move_to(mark_t *self, bint_t line_index, bint_t col);
 int mark_move_to_w_bline(mark_t *self, bline_t *bline, bint_t col);
 int mark_move_vert(mark_t *self, bint_t line_delta);
+int mark_replace_all_cre_between(mark_t *self, mark_t *other, pcre2_code *cre, char *repl, bint_t *optret_num_repls);
 int mark_replace_between(mark_t *self, mark_t *other, char *data, bint_t data_len);
 int mark_replace(mark_t *self, bint_t num_chars, char *data, bint_t data_len);
 int mark_set_pcre_capture(int *rc, PCRE2_SIZE *ovector, int ovector_size);
@@ -302,6 +373,7 @@ int srule_destroy(srule_t *srule);
 // util functions
 void *recalloc(void *ptr, size_t orig_num, size_t new_num, size_t el_size);
 void _mark_mark_move_inner(mark_t *mark, bline_t *bline_target, bint_t col, int do_set_target);
+void _mark_mark_link(mark_t *mark, mark_t *opt_hint);
 void str_append_stop(str_t *str, char *data, char *data_stop);
 void str_append(str_t *str, char *data);
 void str_append_char(str_t *str, char c);
@@ -317,6 +389,10 @@ void str_clear(str_t *str);
 void str_free(str_t *str);
 void str_sprintf(str_t *str, const char *fmt, ...);
 void str_append_replace_with_backrefs(str_t *str, char *subj, char *repl, int pcre_rc, PCRE2_SIZE *pcre_ovector, int pcre_ovecsize);
+void pool_init(pool_t *pool, size_t obj_size, size_t slab_nobjs);
+void *pool_alloc(pool_t *pool);
+void pool_free(pool_t *pool, void *obj);
+void pool_destroy(pool_t *pool);
 size_t utf8_str_length(char *data, size_t len);
 int utf8_char_to_unicode(uint32_t *out, const char *c, const char *stop);
 
@@ -328,12 +404,16 @@ extern pcre2_match_data *pcre2_md;
 
 // #define MLBUF_LARGE_FILE_SIZE 10485760
 #define MLBUF_LARGE_FILE_SIZE 0
+#define MLBUF_POOL_SLAB_NOBJS 256
+#define MLBUF_BRACKET_PAIR_TYPES 3
 
 #define MLBUF_OK 0
 #define MLBUF_ERR 1
 
 #define MLBUF_BACTION_TYPE_INSERT 0
 #define MLBUF_BACTION_TYPE_DELETE 1
+#define MLBUF_BACTION_TYPE_REPLACE 2
+#define MLBUF_BACTION_TYPE_RESET 3 // All lines dropped by buffer_set; not undoable
 
 #define MLBUF_SRULE_TYPE_SINGLE 0
 #define MLBUF_SRULE_TYPE_MULTI 1
@@ -374,4 +454,12 @@ extern pcre2_match_data *pcre2_md;
 #define MLBUF_LETT_MARK(buf, lett) \
     (buf)->lettered_marks[(lett) - 'a']
 
+// bline_brackets_t (sized by MLBUF_BRACKET_PAIR_TYPES above)
+struct bline_brackets_s {
+    bint_t version;
+    bint_t style_version;
+    bint_t delta[MLBUF_BRACKET_PAIR_TYPES]; // Opens minus closes over the line
+    bint_t min_depth[MLBUF_BRACKET_PAIR_TYPES]; // Lowest opens minus closes of any prefix
+};
+
 #endif
@@ -15,6 +15,11 @@ typedef struct editor_s editor_t; // A container for editor-wide globals
 typedef struct bview_s bview_t; // A view of a buffer
 typedef struct bview_rect_s bview_rect_t; // A rectangle in bview with a default styling
 typedef struct bview_listener_s bview_listener_t; // A listener to buffer events in a bview
+typedef struct bview_row_s bview_row_t; // What was last drawn on a bview row
+typedef struct render_line_s render_line_t; // Cached rendered cells of a bline
+typedef struct bracket_pair_s bracket_pair_t; // Cached bracket pair of a buffer position
+typedef struct match_index_s match_index_t; // Cached regex matches in a buffer
+typedef struct match_line_s match_line_t; // Cached regex matches on a line
 typedef void (*bview_listener_cb_t)(bview_t *bview, baction_t *action, void *udata); // A bview_listener_t callback
 typedef struct cursor_s cursor_t; // A cursor (insertion mark + anchor mark) in a buffer
 typedef struct loop_context_s loop_context_t; // Context for a single _editor_loop
@@ -36,6 +41,8 @@ typedef struct editor_prompt_params_s editor_prompt_params_t; // Extra params fo
 typedef struct tb_event tb_event_t; // A termbox event
 typedef struct prompt_history_s prompt_history_t; // A map of prompt histories keyed by prompt_str
 typedef struct prompt_hnode_s prompt_hnode_t; // A node in a linked list of prompt history
+typedef struct grep_ignore_s grep_ignore_t; // A .gitignore pattern used by util_grep
+typedef struct buffer_seen_s buffer_seen_t; // An entry in a set of visited buffers
 typedef int (*cmd_func_t)(cmd_context_t *ctx); // A command function
 typedef int (*observer_func_t)(char *event_name, void *event_data, void *udata); // An event callback function
 typedef struct uscript_s uscript_t; // A userscript
@@ -76,6 +83,15 @@ struct editor_s {
     syntax_t *syntax_map;
     syntax_t *syntax_last;
     int is_display_disabled;
+    int is_display_dirty; // Repaint whole screen on next editor_display
+    bview_t *display_root;
+    size_t display_frames;
+    size_t display_bytes_last; // Bytes written to the terminal by last frame
+    size_t display_bytes_total;
+    struct timeval display_time;
+    int max_fps; // Redraws per second while input is queued, 0 for no limit
+    tb_event_t pending_ev; // Input read ahead to decide whether to redraw
+    int has_pending_ev;
     kmacro_t *macro_map;
     kinput_t macro_toggle_key;
     kmacro_t *macro_record;
@@ -112,6 +128,8 @@ struct editor_s {
     int color_col;
     int soft_wrap;
     int coarse_undo;
+    int undo_max_kb; // Undo memory cap per buffer, 0 for no limit
+    int undo_journal_kb; // Spill undo payloads this big to disk, 0 for never
     int mouse_support;
     int viewport_scope_x; // TODO cli option
     int viewport_scope_y; // TODO cli option
@@ -123,7 +141,8 @@ struct editor_s {
     char *insertbuf;
     size_t insertbuf_size;
     char *cut_buffer;
-    int user_input_count;
+    int action_group; // Undo action group of the current user cmd
+    cmd_func_t action_group_func; // Edit cmd whose run continues action_group
     #define MLE_ERRSTR_SIZE 256
     char errstr[MLE_ERRSTR_SIZE];
     char infostr[MLE_ERRSTR_SIZE];
@@ -177,6 +196,7 @@ struct bview_s {
     int linenum_width;
     int abs_linenum_width;
     int rel_linenum_width;
+    bint_t linenum_mod; // 10 ^ linenum_width, wraps abs line numbers
     bview_rect_t rect_caption;
     bview_rect_t rect_lines;
     bview_rect_t rect_margin_left;
@@ -204,6 +224,22 @@ struct bview_s {
     bint_t *isearch_ranges;
     size_t isearch_ranges_len;
     size_t isearch_ranges_cap;
+    match_index_t *isearch_index;
+    match_index_t *search_index;
+    match_index_t *count_index; // Index whose match count is being shown
+    bview_row_t *rows;
+    int rows_len;
+    uint64_t rows_key;
+    bint_t rows_viewport_y;
+    int is_dirty; // Redraw all rows on next draw
+    render_line_t *render_lines;
+    bint_t render_epoch;
+    bracket_pair_t *bracket_pairs;
+    bint_t bracket_pairs_version; // Buffer version bracket_pairs are valid for
+    srule_span_t *range_spans;
+    int *range_heads;
+    bint_t range_line_index;
+    bint_t range_nlines;
     int tab_width;
     int tab_to_space;
     int soft_wrap;
@@ -223,6 +259,44 @@ struct bview_s {
     bview_t *all_prev;
 };
 
+// bview_row_t
+struct bview_row_s {
+    bline_t *bline;
+    bint_t version;
+    bint_t style_version;
+    bint_t viewport_x;
+    bint_t linenum;
+    bint_t rel_linenum;
+    int is_cursor_line;
+    uint64_t range_key;
+    int is_overlaid; // Cursor or bracket highlight drawn on top
+    int is_valid;
+};
+
+// render_line_t
+struct render_line_s {
+    bline_t *bline;
+    bint_t version;
+    bint_t style_version;
+    bint_t viewport_x;
+    int is_cursor_line;
+    uint64_t range_key;
+    struct tb_cell *cells;
+    int cells_len;
+    bint_t epoch;
+    UT_hash_handle hh;
+};
+
+// bracket_pair_t
+struct bracket_pair_s {
+    bline_t *bline; // Key along with col
+    bint_t col;
+    bline_t *pair_bline;
+    bint_t pair_col;
+    int is_found;
+    UT_hash_handle hh;
+};
+
 // bview_listener_t
 struct bview_listener_s {
     bview_listener_cb_t callback;
@@ -231,6 +305,37 @@ struct bview_listener_s {
     bview_listener_t *prev;
 };
 
+// match_index_t
+struct match_index_s {
+    char *regex;
+    pcre2_code *cre;
+    int is_literal;
+    int is_sorted; // Keep every match start of every line in sorted
+    int is_counted; // All lines counted, later kept up to date by edits
+    bline_t *count_line; // Next line to count, or NULL for first_line
+    match_line_t *lines; // Matches on lines drawn since the last sweep
+    match_line_t **sorted; // Lines with matches in buffer order if is_sorted
+    size_t sorted_len;
+    size_t sorted_cap;
+    size_t numbered_len; // Leading sorted lines whose nth is up to date
+    bint_t count;
+    bint_t epoch;
+};
+
+// match_line_t
+struct match_line_s {
+    bline_t *bline;
+    bint_t version;
+    bint_t *offsets; // Pairs of start/stop byte offsets
+    size_t offsets_len;
+    size_t *matches; // Index into offsets of each non-overlapping match
+    bint_t num_matches;
+    bint_t line_index; // As of the last edit seen by a sorted index
+    bint_t nth; // Number of match starts on sorted lines before this one
+    bint_t epoch;
+    UT_hash_handle hh;
+};
+
 // cursor_t
 struct cursor_s {
     bview_t *bview;
@@ -401,6 +506,23 @@ struct prompt_hnode_s {
     prompt_hnode_t *next;
 };
 
+// grep_ignore_t
+struct grep_ignore_s {
+    char *base; // Dir containing the .gitignore
+    char *pattern;
+    int is_negated;
+    int is_dir_only;
+    int is_anchored;
+    grep_ignore_t *prev;
+    grep_ignore_t *next;
+};
+
+// buffer_seen_t
+struct buffer_seen_s {
+    buffer_t *buffer;
+    UT_hash_handle hh;
+};
+
 // uscript_t
 struct uscript_s {
     editor_t *editor;
@@ -439,6 +561,7 @@ int editor_debug_dump(editor_t *editor, FILE *fp);
 int editor_force_redraw(editor_t *editor);
 int editor_set_input_mode(editor_t *editor);
 int editor_input_to_key(kinput_t *input, char *keyname);
+int editor_start_action_group(editor_t *editor, cmd_func_t func);
 
 // bview functions
 bview_t *bview_get_split_root(bview_t *self);
@@ -453,6 +576,9 @@ int bview_draw(bview_t *self);
 int bview_draw_cursor(bview_t *self, int set_real_cursor);
 int bview_get_active_cursor_count(bview_t *self);
 int bview_get_screen_coords(bview_t *self, mark_t *mark, int *ret_x, int *ret_y, struct tb_cell **optret_cell);
+int bview_match_count(bview_t *self, match_index_t *index, bint_t max_bytes, bint_t *ret_count, int *ret_is_done);
+int bview_match_move(bview_t *self, match_index_t *index, mark_t *mark, int is_prev, bint_t *optret_nth);
+int bview_match_move_nth(bview_t *self, match_index_t *index, mark_t *mark, bint_t nth);
 int bview_max_viewport_y(bview_t *self);
 int bview_open(bview_t *self, char *path, int path_len);
 int bview_pop_kmap(bview_t *bview, kmap_t **optret_kmap);
@@ -462,8 +588,11 @@ int bview_remove_cursor(bview_t *self, cursor_t *cursor);
 int bview_remove_cursors_except(bview_t *self, cursor_t *one);
 int bview_resize(bview_t *self, int x, int y, int w, int h);
 int bview_screen_to_bline_col(bview_t *self, int x, int y, bview_t **ret_bview, bline_t **ret_bline, bint_t *ret_col);
+int bview_set_isearch(bview_t *self, char *opt_regex, int regex_len);
+int bview_set_search(bview_t *self, char *opt_regex);
 int bview_set_syntax(bview_t *self, char *opt_syntax);
 int bview_set_viewport_y(bview_t *self, bint_t y, int do_rectify);
+int bview_sort_cursors(bview_t *self);
 int bview_split(bview_t *self, int is_vertical, float factor, bview_t **optret_bview);
 int bview_wake_sleeping_cursors(bview_t *self);
 int bview_zero_viewport_y(bview_t *self);
@@ -563,6 +692,7 @@ int cmd_push_kmap(cmd_context_t *ctx);
 int cmd_quit(cmd_context_t *ctx);
 int cmd_quit_without_saving(cmd_context_t *ctx);
 int cmd_redo(cmd_context_t *ctx);
+int cmd_redo_branch(cmd_context_t *ctx);
 int cmd_redraw(cmd_context_t *ctx);
 int cmd_remove_extra_cursors(cmd_context_t *ctx);
 int cmd_repeat(cmd_context_t *ctx);
@@ -587,6 +717,8 @@ int cmd_toggle_block(cmd_context_t *ctx);
 int cmd_uncut(cmd_context_t *ctx);
 int cmd_uncut_last(cmd_context_t *ctx);
 int cmd_undo(cmd_context_t *ctx);
+int cmd_undo_earlier(cmd_context_t *ctx);
+int cmd_undo_later(cmd_context_t *ctx);
 int cmd_viewport_bot(cmd_context_t *ctx);
 int cmd_viewport_mid(cmd_context_t *ctx);
 int cmd_viewport_toggle(cmd_context_t *ctx);
@@ -595,6 +727,7 @@ int cmd_wake_sleeping_cursors(cmd_context_t *ctx);
 
 // async functions
 aproc_t *aproc_new(editor_t *editor, void *owner, aproc_t **owner_aproc, char *shell_cmd, int rw, aproc_cb_t fn_callback);
+aproc_t *aproc_new_grep(editor_t *editor, void *owner, aproc_t **owner_aproc, char *re, char *path, aproc_cb_t fn_callback);
 int aproc_set_owner(aproc_t *aproc, void *owner, aproc_t **owner_aproc);
 int aproc_destroy(aproc_t *aproc, int preempt);
 int aproc_drain_all(aproc_t *aprocs, int *ttyfd);
@@ -605,8 +738,10 @@ int uscript_destroy(uscript_t *uscript);
 
 // util functions
 int util_shell_exec(editor_t *editor, char *cmd, long timeout_s, char *input, size_t input_len, int setsid, char *opt_shell, char **optret_output, size_t *optret_output_len, int *optret_exit_code);
+int util_shell_exec_multi(editor_t *editor, char *cmd, long timeout_s, int max_procs, int nruns, char **inputs, size_t *input_lens, char **ret_outputs, size_t *ret_output_lens, int *ret_exit_codes);
 int util_popen2(char *cmd, int setsid, char *opt_shell, int *optret_fdread, int *optret_fdwrite, pid_t *optret_pid);
 int util_get_bracket_pair(uint32_t ch, int *optret_is_closing);
+int util_grep(pcre2_code *cre, char *path, int out_fd);
 int util_is_file(char *path, char *opt_mode, FILE **optret_file);
 int util_is_dir(char *path);
 int util_pcre_match(char *re, char *subject, int subject_len, char **optret_capture, int *optret_capture_len);
@@ -616,6 +751,7 @@ char *util_escape_shell_arg(char *str, int l);
 void util_expand_tilde(char *path, int path_len, char **ret_path, int *ret_path_len);
 int tb_printf_rect(bview_rect_t rect, int x, int y, uint16_t fg, uint16_t bg, const char *fmt, ...);
 int tb_printf_attr(bview_rect_t rect, int x, int y, const char *fmt, ...);
+void tb_clear_rect(int x, int y, int w, int h);
 
 // Globals
 extern editor_t _editor;
@@ -631,6 +767,9 @@ extern editor_t _editor;
 #define MLE_OK 0
 #define MLE_ERR 1
 
+#define MLE_ROW_UNCHANGED 1
+#define MLE_ROW_LINENUM_CHANGED 2
+
 #define MLE_PROMPT_YES "yes"
 #define MLE_PROMPT_NO "no"
 #define MLE_PROMPT_ALL "all"
@@ -644,7 +783,13 @@ extern editor_t _editor;
 #define MLE_DEFAULT_READ_RC_FILE 1
 #define MLE_DEFAULT_SOFT_WRAP 0
 #define MLE_DEFAULT_COARSE_UNDO 0
+#define MLE_DEFAULT_UNDO_MAX_KB 0
+#define MLE_DEFAULT_UNDO_JOURNAL_KB 0
 #define MLE_DEFAULT_MOUSE_SUPPORT 0
+#define MLE_DEFAULT_MAX_FPS 60
+#define MLE_SHELL_MAX_PROCS 16
+#define MLE_MATCH_COUNT_SLICE_BYTES (1024 * 1024)
+#define MLE_GREP_BATCH_BYTES 4096
 
 #define MLE_LOG_ERR(fmt, ...) do { \
     fprintf(stderr, (fmt), __VA_ARGS__); \
@@ -736,7 +881,6 @@ TODO maybe
 [ ] ?allow uscripts to preempt control, use shared uscriptfd
 [ ] ?add vim emulation mode
 [ ] ?make colors, status line, layout configurable
-[ ] ?add multi-level undo/redo
 [ ] ?use wcwidth9 autc instead of relying on locale and wcwidth (tests/unit/test_bline_insert.c)
 */
 
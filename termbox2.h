@@ -490,6 +490,13 @@ int tb_present(void);
  */
 int tb_invalidate(void);
 
+/* Scroll rows `y` thru `y + h - 1` up by `n` rows (down if `n` is negative)
+ * using the terminal's scroll region. Both the front and back buffers are
+ * shifted to match, and exposed rows are blanked. Rows that scrolled into
+ * place are not resent by the next `tb_present`.
+ */
+int tb_scroll(int y, int h, int n);
+
 /* Set the position of the cursor. Upper-left cell is (0, 0). */
 int tb_set_cursor(int cx, int cy);
 int tb_hide_cursor(void);
@@ -727,6 +734,7 @@ int tb_utf8_unicode_to_char(char *out, uint32_t c);
 
 /* Library utility functions */
 int tb_last_errno(void);
+size_t tb_last_present_bytes(void); // Bytes written by the last tb_present
 const char *tb_strerror(int err);
 struct tb_cell *tb_cell_buffer(void); // Deprecated
 int tb_has_truecolor(void);
@@ -837,6 +845,7 @@ struct tb_global {
     struct termios orig_tios;
     int has_orig_tios;
     int last_errno;
+    size_t last_present_bytes;
     int initialized;
     int (*fn_extract_esc_pre)(struct tb_event *, size_t *);
     int (*fn_extract_esc_post)(struct tb_event *, size_t *);
@@ -2307,6 +2316,8 @@ static int send_attr(uintattr_t fg, uintattr_t bg);
 static int send_sgr(uint32_t fg, uint32_t bg, int fg_is_default,
     int bg_is_default);
 static int send_cursor_if(int x, int y);
+static int send_clear_eol(int x, int y);
+static int cell_is_blank(struct tb_cell *c);
 static int send_char(int x, int y, uint32_t ch);
 static int send_cluster(int x, int y, uint32_t *ch, size_t nch);
 static int convert_num(uint32_t num, char *buf);
@@ -2319,6 +2330,7 @@ static int cell_free(struct tb_cell *cell);
 static int cellbuf_init(struct cellbuf *c, int w, int h);
 static int cellbuf_free(struct cellbuf *c);
 static int cellbuf_clear(struct cellbuf *c);
+static int cellbuf_scroll(struct cellbuf *c, int y, int h, int n);
 static int cellbuf_get(struct cellbuf *c, int x, int y, struct tb_cell **out);
 static int cellbuf_in_bounds(struct cellbuf *c, int x, int y);
 static int cellbuf_resize(struct cellbuf *c, int w, int h);
@@ -2413,13 +2425,32 @@ int tb_present(void) {
     global.last_x = -1;
     global.last_y = -1;
 
-    int x, y, i;
+    int x, y, i, blank_x;
     for (y = 0; y < global.front.height; y++) {
+        // Find where the row's trailing run of default-styled blanks starts
+        for (blank_x = global.front.width; blank_x > 0; blank_x--) {
+            struct tb_cell *back;
+            if_err_return(rv, cellbuf_get(&global.back, blank_x - 1, y, &back));
+            if (!cell_is_blank(back)) break;
+        }
         for (x = 0; x < global.front.width;) {
             struct tb_cell *back, *front;
             if_err_return(rv, cellbuf_get(&global.back, x, y, &back));
             if_err_return(rv, cellbuf_get(&global.front, x, y, &front));
 
+            if (x >= blank_x && global.front.width - x > 3
+                && cell_cmp(back, front) != 0)
+            {
+                // Erase rest of row with one sequence instead of spaces
+                if_err_return(rv, send_clear_eol(x, y));
+                for (i = x; i < global.front.width; i++) {
+                    if_err_return(rv, cellbuf_get(&global.back, i, y, &back));
+                    if_err_return(rv, cellbuf_get(&global.front, i, y, &front));
+                    cell_copy(front, back);
+                }
+                break;
+            }
+
             int w;
             {
 #ifdef TB_OPT_EGC
@@ -2471,11 +2502,45 @@ int tb_present(void) {
     }
 
     if_err_return(rv, send_cursor_if(global.cursor_x, global.cursor_y));
+    global.last_present_bytes = global.out.len;
     if_err_return(rv, bytebuf_flush(&global.out, global.wfd));
 
     return TB_OK;
 }
 
+int tb_scroll(int y, int h, int n) {
+    if_not_init_return();
+    int rv;
+    char nbuf[32];
+    if (n == 0 || y < 0 || h < 1 || y + h > global.front.height
+        || n >= h || -n >= h)
+    {
+        return TB_ERR_OUT_OF_BOUNDS;
+    }
+
+    // Exposed rows are filled with the current bg, so reset attrs first
+    if_err_return(rv, send_attr(0, 0));
+    send_literal(rv, "\x1b[");
+    send_num(rv, nbuf, y + 1);
+    send_literal(rv, ";");
+    send_num(rv, nbuf, y + h);
+    send_literal(rv, "r\x1b[");
+    send_num(rv, nbuf, n > 0 ? n : -n);
+    if (n > 0) {
+        send_literal(rv, "S\x1b[r");
+    } else {
+        send_literal(rv, "T\x1b[r");
+    }
+
+    // Setting the scroll region homes the cursor
+    global.last_x = -1;
+    global.last_y = -1;
+
+    if_err_return(rv, cellbuf_scroll(&global.front, y, h, n));
+    if_err_return(rv, cellbuf_scroll(&global.back, y, h, n));
+    return TB_OK;
+}
+
 int tb_invalidate(void) {
     int rv;
     if_not_init_return();
@@ -2798,6 +2863,10 @@ int tb_last_errno(void) {
     return global.last_errno;
 }
 
+size_t tb_last_present_bytes(void) {
+    return global.last_present_bytes;
+}
+
 const char *tb_strerror(int err) {
     switch (err) {
         case TB_OK:
@@ -3973,6 +4042,25 @@ static int send_cursor_if(int x, int y) {
     return TB_OK;
 }
 
+static int send_clear_eol(int x, int y) {
+    int rv;
+    if_err_return(rv, send_attr(0, 0));
+    if (global.last_x != x - 1 || global.last_y != y) {
+        if_err_return(rv, send_cursor_if(x, y));
+    }
+    send_literal(rv, "\x1b[K");
+    global.last_x = x - 1;
+    global.last_y = y;
+    return TB_OK;
+}
+
+static int cell_is_blank(struct tb_cell *c) {
+#ifdef TB_OPT_EGC
+    if (c->nech > 0) return 0;
+#endif
+    return c->ch == ' ' && c->fg == 0 && c->bg == 0;
+}
+
 static int send_char(int x, int y, uint32_t ch) {
     return send_cluster(x, y, &ch, 1);
 }
@@ -3981,10 +4069,17 @@ static int send_cluster(int x, int y, uint32_t *ch, size_t nch) {
     int rv;
     char chu8[8];
 
-    if (global.last_x != x - 1 || global.last_y != y) {
+    if (global.last_y == y && global.last_x >= 0 && x - 1 > global.last_x) {
+        // Skip forward on the same row, shorter than an absolute move
+        char nbuf[32];
+        send_literal(rv, "\x1b[");
+        send_num(rv, nbuf, x - 1 - global.last_x);
+        send_literal(rv, "C");
+    } else if (global.last_x != x - 1 || global.last_y != y) {
         if_err_return(rv, send_cursor_if(x, y));
     }
-    global.last_x = x;
+    // After a wide char, force an absolute move as widths may disagree
+    global.last_x = tb_wcswidth(ch, nch) > 1 ? -1 : x;
     global.last_y = y;
 
     int i;
@@ -4114,6 +4209,39 @@ static int cellbuf_clear(struct cellbuf *c) {
     return TB_OK;
 }
 
+static int cellbuf_scroll(struct cellbuf *c, int y, int h, int n) {
+    int rv, i, an, nmove;
+    uint32_t space = (uint32_t)' ';
+    struct tb_cell *tmp;
+    struct tb_cell *top = c->cells + (size_t)y * c->width;
+
+    // Rotate rows rather than copy so each cell keeps sole ownership of its
+    // grapheme buffer, then blank the rows rotated into the exposed area
+    an = n > 0 ? n : -n;
+    nmove = h - an;
+    tmp = (struct tb_cell *)tb_malloc(sizeof(*tmp) * (size_t)an * c->width);
+    if (!tmp) return TB_ERR_MEM;
+    if (n > 0) {
+        memcpy(tmp, top, sizeof(*tmp) * (size_t)an * c->width);
+        memmove(top, top + (size_t)an * c->width,
+            sizeof(*tmp) * (size_t)nmove * c->width);
+        memcpy(top + (size_t)nmove * c->width, tmp,
+            sizeof(*tmp) * (size_t)an * c->width);
+        top += (size_t)nmove * c->width;
+    } else {
+        memcpy(tmp, top + (size_t)nmove * c->width,
+            sizeof(*tmp) * (size_t)an * c->width);
+        memmove(top + (size_t)an * c->width, top,
+            sizeof(*tmp) * (size_t)nmove * c->width);
+        memcpy(top, tmp, sizeof(*tmp) * (size_t)an * c->width);
+    }
+    tb_free(tmp);
+    for (i = 0; i < an * c->width; i++) {
+        if_err_return(rv, cell_set(&top[i], &space, 1, 0, 0));
+    }
+    return TB_OK;
+}
+
 static int cellbuf_get(struct cellbuf *c, int x, int y,
     struct tb_cell **out) {
     if (!cellbuf_in_bounds(c, x, y)) {
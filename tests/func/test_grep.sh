@@ -0,0 +1,38 @@
+#!/usr/bin/env bash
+
+# make tmpdir and delete at exit
+this_dir=$(pwd)
+tmpdir=$(mktemp -d)
+cd $tmpdir
+finish() { cd $this_dir; rm -rf $tmpdir; }
+trap finish EXIT
+
+# setup tmpdir
+mkdir -p aignored sub
+echo 'aignored/' >.gitignore
+echo 'needle' >aignored/a.txt
+printf 'needle\0' >b.bin
+printf 'hay\nneedle\n' >c.txt
+printf 'hay\nhay\nneedle\n' >sub/d.txt
+
+# ensure ignored and binary files are skipped by the built-in grep
+macro='M-q n e e d l e enter enter'
+declare -A expected
+expected[grep_path]='^bview.[[:digit:]]+.buffer.path=./c.txt$'
+expected[grep_line]='^bview.1.cursor.0.mark.line_index=1$'
+source "$this_dir/test.sh"
+
+# ensure results are sorted by path
+macro='M-q n e e d l e enter down enter'
+declare -A expected
+expected[grep_sub_path]='^bview.[[:digit:]]+.buffer.path=./sub/d.txt$'
+expected[grep_sub_line]='^bview.1.cursor.0.mark.line_index=2$'
+source "$this_dir/test.sh"
+
+# ensure a static param overrides the built-in grep
+extra_opts=(-k 'cmd_grep,M-q,grep --color=never -n -r %s sub')
+macro='M-q n e e d l e enter enter'
+declare -A expected
+expected[grep_ext_path]='^bview.[[:digit:]]+.buffer.path=sub/d.txt$'
+expected[grep_ext_line]='^bview.1.cursor.0.mark.line_index=2$'
+source "$this_dir/test.sh"
@@ -12,6 +12,12 @@ expected[drop_wake_data        ]='^XXhi XX$'
 expected[drop_wake_cursor_count]='^bview.0.cursor_count=2$'
 source 'test.sh'
 
+macro='a b C-/ . C-/ a X'
+declare -A expected
+expected[merge_data        ]='^abX$'
+expected[merge_cursor_count]='^bview.0.cursor_count=1$'
+source 'test.sh'
+
 macro="o n e enter t w o enter t h r e e M-a M-\ C-/ ' C-e space a n d"
 declare -A expected
 expected[column_data1       ]='^one and$'
@@ -35,6 +35,32 @@ expected[next_wrap_cursor_line]='^bview.0.cursor.0.mark.line_index=0$'
 expected[next_wrap_cursor_col ]='^bview.0.cursor.0.mark.col=0$'
 source 'test.sh'
 
+# cmd_search_prev (match added by edit)
+macro='h i enter x enter h i C-f h i enter down h i CM-g'
+declare -A expected
+expected[prev_edit_cursor_line]='^bview.0.cursor.0.mark.line_index=1$'
+expected[prev_edit_cursor_col ]='^bview.0.cursor.0.mark.col=0$'
+source 'test.sh'
+
+# cmd_search (match count kept up to date by edits)
+macro='a a enter a a enter x C-f a a enter delete end delete a'
+declare -A expected
+expected[count_edit_data ]='^aaaa$'
+expected[count_edit_count]='^bview.0.search_count=3$'
+source 'test.sh'
+
+# cmd_search_next (overlapping matches)
+macro='a a a a C-f a a enter C-g C-g'
+declare -A expected
+expected[overlap_next_cursor_col]='^bview.0.cursor.0.mark.col=2$'
+source 'test.sh'
+
+# cmd_search_prev (overlapping matches, wrap)
+macro='a a a a C-f a a enter CM-g'
+declare -A expected
+expected[overlap_prev_cursor_col]='^bview.0.cursor.0.mark.col=2$'
+source 'test.sh'
+
 # cmd_find_word
 macro='h e l l o enter h e l l o left C-v'
 declare -A expected
@@ -70,6 +96,13 @@ expected[isearch_cursor_line]='^bview.0.cursor.0.mark.line_index=3$'
 expected[iesarch_cursor_col ]='^bview.0.cursor.0.mark.col=0$'
 source 'test.sh'
 
+# cmd_isearch 3 (extend then shorten literal)
+macro='a b enter a b c enter a b d M-\ C-r a b c backspace d enter'
+declare -A expected
+expected[isearch3_cursor_line]='^bview.0.cursor.0.mark.line_index=2$'
+expected[isearch3_cursor_col ]='^bview.0.cursor.0.mark.col=0$'
+source 'test.sh'
+
 # cmd_replace 1
 macro='a 1 space b 2 space c 3 space d 4 C-t \ d + enter x enter y n a'
 declare -A expected
@@ -90,6 +123,19 @@ expected[replace3_data2]='^Babc$'
 expected[replace3_data3]='^C$'
 source 'test.sh'
 
+# cmd_replace (all, empty match at eol)
+macro='a b enter c d up C-a C-t $ enter ! enter a'
+declare -A expected
+expected[replace_eol_data1]='^ab!$'
+expected[replace_eol_data2]='^cd$'
+source 'test.sh'
+
+# cmd_replace (all, empty match at word boundary)
+macro='a b space c d C-a C-t \ b enter | enter a'
+declare -A expected
+expected[replace_wordb_data]='^\|ab\| \|cd$'
+source 'test.sh'
+
 # cmd_search history
 macro='h e l l o enter h e l l o C-f h e l l o enter C-f up enter'
 declare -A expected
@@ -113,8 +159,28 @@ expected[replace_all_2_2]='^b2$'
 expected[replace_all_2_3]='^3c$'
 source 'test.sh'
 
+# cmd_replace_all (non-interactive, one undo per buffer)
+extra_opts=(-k cmd_replace_all,M-y,all)
+macro='1 a C-n 2 b b C-n 3 c M-y ( \ d ) ( \ w ) enter $ 2 $ 1 enter C-z'
+declare -A expected
+expected[replace_all_3_1]='^a1$'
+expected[replace_all_3_2]='^b2b$'
+expected[replace_all_3_3]='^3c$'
+source 'test.sh'
+unset extra_opts
+
 # cmd_replace_all (avoid infinite replacement)
 macro='a enter C-t ^ enter enter a'
 declare -A expected
 expected[replace_no_inf_loop]='^a$'
 source 'test.sh'
+
+# cmd_replace_all (non-interactive, within selection)
+extra_opts=(-k cmd_replace_all,M-y,all)
+macro='1 a enter 2 b b enter 3 c up home M-a end M-y ( \ d ) ( \ w ) enter $ 2 $ 1 enter'
+declare -A expected
+expected[replace_all_sel_1]='^1a$'
+expected[replace_all_sel_2]='^b2b$'
+expected[replace_all_sel_3]='^3c$'
+source 'test.sh'
+unset extra_opts
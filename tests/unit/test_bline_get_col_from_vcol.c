@@ -0,0 +1,36 @@
+#include "test.h"
+
+char *str = "a\tb\tc";
+
+void test(buffer_t *buf, mark_t *cur) {
+//  vcol 0 123 4 567 8
+//  col  0 1   2 3   4
+    bint_t col;
+    buffer_set_tab_width(buf, 4);
+    MLBUF_BLINE_ENSURE_CHARS(buf->first_line);
+    ASSERT("vwidth", 9, buf->first_line->char_vwidth);
+
+    bline_get_col_from_vcol(buf->first_line, 0, &col);
+    ASSERT("0", 0, col);
+
+    bline_get_col_from_vcol(buf->first_line, 1, &col);
+    ASSERT("1", 1, col);
+
+    bline_get_col_from_vcol(buf->first_line, 2, &col);
+    ASSERT("2", 2, col);
+
+    bline_get_col_from_vcol(buf->first_line, 4, &col);
+    ASSERT("4", 2, col);
+
+    bline_get_col_from_vcol(buf->first_line, 5, &col);
+    ASSERT("5", 3, col);
+
+    bline_get_col_from_vcol(buf->first_line, 6, &col);
+    ASSERT("6", 4, col);
+
+    bline_get_col_from_vcol(buf->first_line, 8, &col);
+    ASSERT("8", 4, col);
+
+    bline_get_col_from_vcol(buf->first_line, 9, &col);
+    ASSERT("9", 5, col);
+}
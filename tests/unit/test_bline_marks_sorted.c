@@ -0,0 +1,74 @@
+#include "test.h"
+
+char *str = "";
+
+#define NUM_MARKS 2000
+
+static int count_unsorted(buffer_t *buf) {
+    bline_t *bline;
+    mark_t *mark;
+    int n;
+    n = 0;
+    for (bline = buf->first_line; bline; bline = bline->next) {
+        DL_FOREACH(bline->marks, mark) {
+            if (mark->bline != bline) n += 1;
+            if (mark->next && mark->next->col < mark->col) n += 1;
+        }
+    }
+    return n;
+}
+
+void test(buffer_t *buf, mark_t *cur) {
+    mark_t *marks[NUM_MARKS];
+    char *text;
+    int nmismatch;
+    int i;
+
+    // One line with a mark on every col, every third one lefty
+    text = malloc(NUM_MARKS);
+    memset(text, 'a', NUM_MARKS);
+    buffer_insert(buf, 0, text, NUM_MARKS, NULL);
+    free(text);
+    for (i = NUM_MARKS - 1; i >= 0; i--) {
+        marks[i] = buffer_add_mark(buf, buf->first_line, i);
+        marks[i]->lefty = i % 3 == 0 ? 1 : 0;
+    }
+    ASSERT("add", 0, count_unsorted(buf));
+
+    // Insert shifts righty marks at col and all marks after it
+    bline_insert(buf->first_line, 999, "xy", 2, NULL);
+    nmismatch = 0;
+    for (i = 0; i < NUM_MARKS; i++) {
+        if (marks[i]->col != (i > 999 || (i == 999 && !marks[i]->lefty) ? i + 2 : i)) nmismatch += 1;
+    }
+    ASSERT("ins", 0, nmismatch);
+    ASSERT("ins_sorted", 0, count_unsorted(buf));
+
+    // Delete pulls marks in the range back to the delete col
+    bline_delete(buf->first_line, 998, 4);
+    nmismatch = 0;
+    for (i = 0; i < NUM_MARKS; i++) {
+        if (marks[i]->col != (i < 998 ? i : (i < 1000 ? 998 : i - 2))) nmismatch += 1;
+    }
+    ASSERT("del", 0, nmismatch);
+    ASSERT("del_sorted", 0, count_unsorted(buf));
+
+    // Break moves the tail of the list to the new line
+    bline_insert(buf->first_line, 1500, "\n", 1, NULL);
+    ASSERT("brk_line", buf->first_line->next, marks[1502]->bline);
+    ASSERT("brk_col", 0, marks[1502]->col);
+    ASSERT("brk_sorted", 0, count_unsorted(buf));
+
+    // Moves keep the list sorted
+    for (i = 0; i < NUM_MARKS; i++) {
+        mark_move_to(marks[i], i % 2, (i * 7) % 1000);
+    }
+    ASSERT("move_sorted", 0, count_unsorted(buf));
+
+    // Undo shifts everything back
+    buffer_undo(buf);
+    buffer_undo(buf);
+    buffer_undo(buf);
+    ASSERT("undo_lc", 1, buf->line_count);
+    ASSERT("undo_sorted", 0, count_unsorted(buf));
+}
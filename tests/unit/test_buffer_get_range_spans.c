@@ -0,0 +1,96 @@
+#include "test.h"
+
+char *str = "";
+
+#define NUM_RANGES 1000
+
+static srule_t *find_span(srule_span_t *spans, int head, bint_t col) {
+    int i;
+    for (i = head; i >= 0; i = spans[i].next) {
+        if (col >= spans[i].start_col && (spans[i].end_col < 0 || col < spans[i].end_col)) {
+            return spans[i].srule;
+        }
+    }
+    return NULL;
+}
+
+static srule_t *find_naive(buffer_t *buf, bline_t *bline, bint_t col, int is_block) {
+    mark_t mark = {0};
+    srule_node_t *node;
+    mark.bline = bline;
+    mark.col = col;
+    DL_FOREACH(buf->range_srules, node) {
+        if (is_block
+            ? mark_block_is_between(&mark, node->srule->range_a, node->srule->range_b)
+            : mark_is_between(&mark, node->srule->range_a, node->srule->range_b)
+        ) {
+            return node->srule;
+        }
+    }
+    return NULL;
+}
+
+void test(buffer_t *buf, mark_t *cur) {
+    srule_t *srules[NUM_RANGES + 1];
+    mark_t *marks[(NUM_RANGES + 1) * 2];
+    srule_span_t *spans;
+    int *heads;
+    bline_t *bline;
+    bint_t col;
+    int is_block;
+    int nspans;
+    int nmismatch;
+    int i;
+
+    // One line per anchored cursor plus a multi-line selection on top
+    for (i = 0; i < NUM_RANGES; i++) {
+        buffer_insert(buf, buf->byte_count, "hello world\n", 12, NULL);
+    }
+    marks[0] = buffer_add_mark(buf, NULL, 0);
+    marks[1] = buffer_add_mark(buf, NULL, 0);
+    mark_move_to(marks[0], 12, 2);
+    mark_move_to(marks[1], 10, 3);
+    srules[0] = srule_new_range(marks[0], marks[1], 0, 0);
+    buffer_add_srule(buf, srules[0]);
+    for (i = 1; i <= NUM_RANGES; i++) {
+        marks[i * 2] = buffer_add_mark(buf, NULL, 0);
+        marks[i * 2 + 1] = buffer_add_mark(buf, NULL, 0);
+        mark_move_to(marks[i * 2], i - 1, i % 5);
+        mark_move_to(marks[i * 2 + 1], i - 1, i % 5 + 4);
+        srules[i] = srule_new_range(marks[i * 2], marks[i * 2 + 1], 0, 0);
+        buffer_add_srule(buf, srules[i]);
+    }
+
+    for (is_block = 0; is_block <= 1; is_block++) {
+        buffer_get_range_spans(buf, 0, buf->line_count, is_block, &spans, &heads);
+        nmismatch = 0;
+        nspans = 0;
+        for (bline = buf->first_line; bline; bline = bline->next) {
+            for (i = heads[bline->line_index]; i >= 0; i = spans[i].next) nspans += 1;
+            for (col = 0; col <= bline->char_count; col++) {
+                if (find_span(spans, heads[bline->line_index], col) != find_naive(buf, bline, col, is_block)) {
+                    nmismatch += 1;
+                }
+            }
+        }
+        ASSERT("nmismatch", 0, nmismatch);
+        ASSERT("nspans", NUM_RANGES + 3, nspans);
+        free(spans);
+        free(heads);
+    }
+
+    // Lines outside the window are not indexed
+    buffer_get_range_spans(buf, 11, 2, 0, &spans, &heads);
+    ASSERT("win0", 0, spans[heads[0]].start_col);
+    ASSERT("win0end", -1, spans[heads[0]].end_col);
+    ASSERT("win0next", srules[12], spans[spans[heads[0]].next].srule);
+    ASSERT("win1", srules[0], spans[heads[1]].srule);
+    ASSERT("win1end", 2, spans[heads[1]].end_col);
+    free(spans);
+    free(heads);
+
+    for (i = 0; i <= NUM_RANGES; i++) {
+        buffer_remove_srule(buf, srules[i]);
+        srule_destroy(srules[i]);
+    }
+}
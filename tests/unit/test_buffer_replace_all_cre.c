@@ -0,0 +1,65 @@
+#include "test.h"
+
+char *str = "foo bar foo\nbaz\nfoo foo\n";
+
+void test(buffer_t *buf, mark_t *cur) {
+    char *data;
+    bint_t data_len;
+    bint_t num_repls;
+    pcre2_code *cre;
+    int errcode;
+    PCRE2_SIZE erroffset;
+    mark_t *end;
+    mark_t *other;
+
+    cre = pcre2_compile((PCRE2_SPTR)"f(o+)", PCRE2_ZERO_TERMINATED, PCRE2_CASELESS, &errcode, &erroffset, NULL);
+    end = buffer_add_mark(buf, NULL, 0);
+    other = buffer_add_mark(buf, NULL, 0);
+    mark_move_beginning(cur);
+    mark_move_end(end);
+    mark_move_to(other, 2, 4);
+
+    buffer_replace_all_cre(buf, cur->bline, cur->col, end->bline, end->col, cre, "x$1x", &num_repls);
+    buffer_get(buf, &data, &data_len);
+    ASSERT("num", 4, num_repls);
+    ASSERT("rpl1", 0, strncmp(data, "xoox bar xoox\nbaz\nxoox xoox\n", data_len));
+    ASSERT("r1bc", data_len, buf->byte_count);
+    ASSERT("r1lc", 4, buf->line_count);
+    ASSERT("r1ml", 2, other->bline->line_index);
+    ASSERT("r1mc", 5, other->col);
+
+    buffer_undo(buf);
+    buffer_get(buf, &data, &data_len);
+    ASSERT("undo1", 0, strncmp(data, "foo bar foo\nbaz\nfoo foo\n", data_len));
+
+    buffer_redo(buf);
+    buffer_get(buf, &data, &data_len);
+    ASSERT("redo1", 0, strncmp(data, "xoox bar xoox\nbaz\nxoox xoox\n", data_len));
+    pcre2_code_free(cre);
+
+    cre = pcre2_compile((PCRE2_SPTR)" ", PCRE2_ZERO_TERMINATED, 0, &errcode, &erroffset, NULL);
+    mark_move_beginning(cur);
+    mark_move_to(end, 2, 0);
+    buffer_replace_all_cre(buf, cur->bline, cur->col, end->bline, end->col, cre, "$n", &num_repls);
+    buffer_get(buf, &data, &data_len);
+    ASSERT("num2", 2, num_repls);
+    ASSERT("rpl2", 0, strncmp(data, "xoox\nbar\nxoox\nbaz\nxoox xoox\n", data_len));
+    ASSERT("r2bc", data_len, buf->byte_count);
+    ASSERT("r2lc", 6, buf->line_count);
+    ASSERT("r2li", 5, buf->last_line->line_index);
+
+    buffer_undo(buf);
+    buffer_get(buf, &data, &data_len);
+    ASSERT("undo2", 0, strncmp(data, "xoox bar xoox\nbaz\nxoox xoox\n", data_len));
+    ASSERT("u2lc", 4, buf->line_count);
+    pcre2_code_free(cre);
+
+    cre = pcre2_compile((PCRE2_SPTR)"^", PCRE2_ZERO_TERMINATED, 0, &errcode, &erroffset, NULL);
+    mark_move_beginning(cur);
+    mark_move_end(end);
+    buffer_replace_all_cre(buf, cur->bline, cur->col, end->bline, end->col, cre, "> ", &num_repls);
+    buffer_get(buf, &data, &data_len);
+    ASSERT("num3", 3, num_repls);
+    ASSERT("rpl3", 0, strncmp(data, "> xoox bar xoox\n> baz\n> xoox xoox\n", data_len));
+    pcre2_code_free(cre);
+}
@@ -2,10 +2,45 @@
 
 char *str = "hello\nworld";
 
+static int num_resets;
+static bint_t reset_byte_delta;
+
+static void callback_fn(buffer_t *buf, baction_t *bac, void *udata) {
+    if (bac && bac->type == MLBUF_BACTION_TYPE_RESET) {
+        num_resets += 1;
+        reset_byte_delta = bac->byte_delta;
+    }
+}
+
 void test(buffer_t *buf, mark_t *cur) {
     char *data;
     bint_t data_len;
+    mark_move_to(cur, 1, 3);
     buffer_set(buf, "goodbye\nvoid", 12);
     buffer_get(buf, &data, &data_len);
     ASSERT("set", 0, strncmp("goodbye\nvoid", data, data_len));
+
+    // No undo history is kept, and marks survive at the end of the new data
+    ASSERT("actions", NULL, buf->actions);
+    ASSERT("undo", MLBUF_ERR, buffer_undo(buf));
+    ASSERT("lc", 2, buf->line_count);
+    ASSERT("mline", buf->last_line, cur->bline);
+    ASSERT("mcol", 4, cur->col);
+
+    buffer_set_mmapped(buf, "a\nb\nc", 5);
+    buffer_get(buf, &data, &data_len);
+    ASSERT("mmap", 0, strncmp("a\nb\nc", data, data_len));
+    ASSERT("mmap_lc", 3, buf->line_count);
+    ASSERT("mmap_mline", buf->first_line, cur->bline);
+    ASSERT("mmap_mcol", 0, cur->col);
+
+    // Setting raises one reset on the listener, even if set to nothing
+    buf->is_unsaved = 0;
+    buffer_set_callback(buf, callback_fn, NULL);
+    buffer_set(buf, "", 0);
+    ASSERT("reset_count", 1, num_resets);
+    ASSERT("reset_bdelta", -5, reset_byte_delta);
+    ASSERT("reset_unsaved", 1, buf->is_unsaved);
+    ASSERT("reset_bc", 0, buf->byte_count);
+    buffer_set_callback(buf, NULL, NULL);
 }
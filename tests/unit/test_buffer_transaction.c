@@ -0,0 +1,64 @@
+#include "test.h"
+
+char *str = "";
+
+#define NUM_LINES 5000
+
+static int ncallbacks = 0;
+static int ncommits = 0;
+static bint_t line_delta = 0;
+
+static void callback(buffer_t *buf, baction_t *action, void *udata) {
+    if (!action) {
+        ncommits += 1;
+        return;
+    }
+    ncallbacks += 1;
+    line_delta += action->line_delta;
+}
+
+void test(buffer_t *buf, mark_t *cur) {
+    char *text;
+    bint_t i;
+    int action_group;
+    int nmismatch;
+    bline_t *bline;
+
+    text = malloc(NUM_LINES * 4);
+    for (i = 0; i < NUM_LINES; i++) memcpy(text + i * 4, "foo\n", 4);
+    buffer_insert(buf, 0, text, NUM_LINES * 4, NULL);
+    free(text);
+
+    // Split every line bottom-up, like one edit per cursor
+    action_group = 1;
+    buffer_set_action_group_ptr(buf, &action_group);
+    buffer_set_callback(buf, callback, NULL);
+    buffer_begin_transaction(buf);
+    for (bline = buf->last_line->prev; bline; bline = bline->prev) {
+        buffer_insert_w_bline(buf, bline, 1, "\n", 1, NULL);
+    }
+    ASSERT("cb", NUM_LINES, ncallbacks);
+    ASSERT("cb_commit_deferred", 0, ncommits);
+    buffer_commit_transaction(buf);
+    buffer_set_callback(buf, NULL, NULL);
+    ASSERT("cb_commit", 1, ncommits);
+    ASSERT("cb_delta", (bint_t)NUM_LINES, line_delta);
+    ASSERT("lc", (bint_t)NUM_LINES * 2 + 1, buf->line_count);
+    ASSERT("last", (bint_t)NUM_LINES * 2, buf->last_line->line_index);
+    ASSERT("last_next", NULL, buf->last_line->next);
+    nmismatch = 0;
+    for (i = 0, bline = buf->first_line; bline; i++, bline = bline->next) {
+        if (bline->line_index != i) nmismatch += 1;
+    }
+    ASSERT("index", 0, nmismatch);
+
+    // One undo reverts the whole transaction
+    ASSERT("undo", MLBUF_OK, buffer_undo_action_group(buf));
+    ASSERT("undo_lc", (bint_t)NUM_LINES + 1, buf->line_count);
+    ASSERT("undo_last", (bint_t)NUM_LINES, buf->last_line->line_index);
+    nmismatch = 0;
+    for (i = 0, bline = buf->first_line; bline != buf->last_line; i++, bline = bline->next) {
+        if (bline->line_index != i || bline->data_len != 3) nmismatch += 1;
+    }
+    ASSERT("undo_data", 0, nmismatch);
+}
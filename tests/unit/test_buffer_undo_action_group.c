@@ -0,0 +1,43 @@
+#include "test.h"
+
+char *str = "";
+
+#define NUM_LINES 50000
+
+void test(buffer_t *buf, mark_t *cur) {
+    char *text;
+    bint_t i;
+    int action_group;
+    int nmismatch;
+    bline_t *bline;
+
+    text = malloc(NUM_LINES * 8);
+    for (i = 0; i < NUM_LINES; i++) memcpy(text + i * 8, "foo bar\n", 8);
+    buffer_insert(buf, 0, text, NUM_LINES * 8, NULL);
+    free(text);
+
+    // Replace all in one action group, like cmd_replace does
+    action_group = 1;
+    buffer_set_action_group_ptr(buf, &action_group);
+    for (bline = buf->first_line; bline != buf->last_line; bline = bline->next) {
+        bline_replace(bline, 0, 3, "quux", 4);
+    }
+    ASSERT("rpl_bc", (bint_t)NUM_LINES * 9, buf->byte_count);
+
+    // Undoing and redoing the group should be linear in its size
+    ASSERT("undo", MLBUF_OK, buffer_undo_action_group(buf));
+    ASSERT("undo_bc", (bint_t)NUM_LINES * 8, buf->byte_count);
+    nmismatch = 0;
+    for (bline = buf->first_line; bline != buf->last_line; bline = bline->next) {
+        if (bline->data_len != 7 || strncmp(bline->data, "foo bar", 7) != 0) nmismatch += 1;
+    }
+    ASSERT("undo_data", 0, nmismatch);
+
+    ASSERT("redo", MLBUF_OK, buffer_redo_action_group(buf));
+    ASSERT("redo_bc", (bint_t)NUM_LINES * 9, buf->byte_count);
+    nmismatch = 0;
+    for (bline = buf->first_line; bline != buf->last_line; bline = bline->next) {
+        if (bline->data_len != 8 || strncmp(bline->data, "quux bar", 8) != 0) nmismatch += 1;
+    }
+    ASSERT("redo_data", 0, nmismatch);
+}
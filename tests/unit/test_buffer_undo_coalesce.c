@@ -0,0 +1,68 @@
+#include "test.h"
+
+char *str = "hi";
+
+void test(buffer_t *buf, mark_t *cur) {
+    char *data;
+    bint_t data_len;
+    bint_t undo_bytes;
+    baction_t *action;
+    int action_group;
+    int count;
+
+    action_group = 1; // Initial insert of str is in group 0
+    buffer_set_action_group_ptr(buf, &action_group);
+    buffer_set_undo_coalesced(buf, 1);
+
+    // Inserts at advancing cols in one group fold into one action
+    buffer_insert(buf, 2, "t", 1, NULL);
+    buffer_insert(buf, 3, "he", 2, NULL);
+    buffer_insert(buf, 5, "re", 2, NULL);
+    count = 0;
+    DL_COUNT(buf->actions, action, count);
+    ASSERT("ins_count", 2, count);
+    ASSERT("ins_data", 0, strncmp(buf->action_tail->data, "there", 5));
+
+    // A new group starts a new action
+    action_group += 1;
+    buffer_insert(buf, 7, "!", 1, NULL);
+    DL_COUNT(buf->actions, action, count);
+    ASSERT("grp_count", 3, count);
+    buffer_undo(buf);
+    buffer_get(buf, &data, &data_len);
+    ASSERT("grp_undo", 0, strncmp(data, "hithere", data_len));
+    buffer_undo(buf);
+    buffer_get(buf, &data, &data_len);
+    ASSERT("ins_undo", 0, strncmp(data, "hi", data_len));
+    buffer_redo(buf);
+    buffer_get(buf, &data, &data_len);
+    ASSERT("ins_redo", 0, strncmp(data, "hithere", data_len));
+
+    // Backspacing a run folds too
+    action_group += 1;
+    buffer_delete(buf, 6, 1);
+    buffer_delete(buf, 5, 1);
+    buffer_delete(buf, 4, 1);
+    DL_COUNT(buf->actions, action, count);
+    ASSERT("bs_count", 3, count);
+    buffer_undo(buf);
+    buffer_get(buf, &data, &data_len);
+    ASSERT("bs_undo", 0, strncmp(data, "hithere", data_len));
+    buffer_redo(buf);
+    buffer_get(buf, &data, &data_len);
+    ASSERT("bs_redo", 0, strncmp(data, "hith", data_len));
+
+    // Capping undo memory drops the oldest actions but keeps the newest
+    undo_bytes = buf->undo_bytes;
+    action_group += 1;
+    buffer_insert(buf, 0, "x", 1, NULL);
+    ASSERT("bytes", 1, buf->undo_bytes > undo_bytes ? 1 : 0);
+    buffer_set_undo_max_bytes(buf, 1);
+    DL_COUNT(buf->actions, action, count);
+    ASSERT("cap_count", 1, count);
+    ASSERT("cap_bytes", (bint_t)sizeof(baction_t) + 1, buf->undo_bytes);
+    buffer_undo(buf);
+    buffer_get(buf, &data, &data_len);
+    ASSERT("cap_undo", 0, strncmp(data, "hith", data_len));
+    ASSERT("cap_undo2", MLBUF_ERR, buffer_undo(buf));
+}
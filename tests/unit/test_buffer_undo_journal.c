@@ -0,0 +1,43 @@
+#include "test.h"
+
+char *str = "hello world\n";
+
+void test(buffer_t *buf, mark_t *cur) {
+    char *data;
+    bint_t data_len;
+    bint_t undo_bytes;
+
+    ASSERT("set", MLBUF_OK, buffer_set_undo_journal(buf, NULL, 4));
+
+    // Small payloads stay in memory
+    buffer_insert(buf, 0, "ab", 2, NULL);
+    ASSERT("small", 0, buf->action_tail->is_journaled);
+
+    // Big payloads spill to the journal leaving only metadata
+    undo_bytes = buf->undo_bytes;
+    buffer_delete(buf, 2, 6);
+    ASSERT("big", 1, buf->action_tail->is_journaled);
+    ASSERT("bigdata", NULL, buf->action_tail->data);
+    ASSERT("bigbytes", (bint_t)sizeof(baction_t), buf->undo_bytes - undo_bytes);
+    ASSERT("jlen", 6, buf->undo_journal_len);
+
+    buffer_undo(buf);
+    buffer_get(buf, &data, &data_len);
+    ASSERT("undo", 0, strncmp(data, "abhello world\n", data_len));
+    ASSERT("undojnl", 1, buf->action_tail->is_journaled);
+    buffer_redo(buf);
+    buffer_get(buf, &data, &data_len);
+    ASSERT("redo", 0, strncmp(data, "abworld\n", data_len));
+    buffer_undo(buf);
+    buffer_undo(buf);
+    buffer_get(buf, &data, &data_len);
+    ASSERT("undo2", 0, strncmp(data, "hello world\n", data_len));
+
+    // Closing the journal pulls payloads back into memory
+    buffer_redo(buf);
+    ASSERT("off", MLBUF_OK, buffer_set_undo_journal(buf, NULL, 0));
+    ASSERT("offjnl", 0, buf->action_tail->is_journaled);
+    buffer_redo(buf);
+    buffer_get(buf, &data, &data_len);
+    ASSERT("redo2", 0, strncmp(data, "abworld\n", data_len));
+}
@@ -0,0 +1,94 @@
+#include "test.h"
+
+char *str = "";
+
+void test(buffer_t *buf, mark_t *cur) {
+    char *data;
+    bint_t data_len;
+    int count;
+    baction_branch_t *branch;
+
+    buffer_insert(buf, 0, "a", 1, NULL);
+    buffer_insert(buf, 1, "b", 1, NULL);
+
+    // An edit after undo keeps the undone action as a branch
+    buffer_undo(buf);
+    buffer_insert(buf, 1, "c", 1, NULL);
+    ASSERT("nobranch_redo", MLBUF_ERR, buffer_redo(buf));
+    DL_COUNT(buf->undo_branches, branch, count);
+    ASSERT("count1", 1, count);
+    ASSERT("parent1", buf->actions, buf->undo_branches->parent);
+
+    // Switching branches swaps the undone actions without replaying them
+    buffer_undo(buf);
+    ASSERT("switch1", MLBUF_OK, buffer_switch_undo_branch(buf));
+    buffer_get(buf, &data, &data_len);
+    ASSERT("switch1_data", 0, strncmp(data, "a", data_len));
+    buffer_redo(buf);
+    buffer_get(buf, &data, &data_len);
+    ASSERT("redo1", 0, strncmp(data, "ab", data_len));
+    buffer_undo(buf);
+    ASSERT("switch2", MLBUF_OK, buffer_switch_undo_branch(buf));
+    buffer_redo(buf);
+    buffer_get(buf, &data, &data_len);
+    ASSERT("redo2", 0, strncmp(data, "ac", data_len));
+
+    // Branches pile up at the same point
+    buffer_undo(buf);
+    buffer_insert(buf, 1, "d", 1, NULL);
+    DL_COUNT(buf->undo_branches, branch, count);
+    ASSERT("count2", 2, count);
+    buffer_undo(buf);
+    ASSERT("switch3", MLBUF_OK, buffer_switch_undo_branch(buf));
+    buffer_redo(buf);
+    buffer_get(buf, &data, &data_len);
+    ASSERT("redo3", 0, strncmp(data, "ab", data_len));
+
+    // No branches at start of history
+    buffer_undo(buf);
+    buffer_undo(buf);
+    buffer_get(buf, &data, &data_len);
+    ASSERT("undo_all", 0, data_len);
+    ASSERT("switch_root", MLBUF_ERR, buffer_switch_undo_branch(buf));
+
+    // Branches are dropped first when capping undo memory
+    buffer_redo(buf);
+    buffer_insert(buf, 1, "e", 1, NULL);
+    buffer_set_undo_max_bytes(buf, 1);
+    ASSERT("capped", NULL, buf->undo_branches);
+    buffer_undo(buf);
+    buffer_get(buf, &data, &data_len);
+    ASSERT("cap_undo", 0, strncmp(data, "a", data_len));
+
+    // Undo by time visits states in the order they were recorded
+    buffer_set_undo_max_bytes(buf, 0);
+    buffer_set(buf, "", 0);
+    buffer_insert(buf, 0, "a", 1, NULL);
+    buffer_insert(buf, 1, "b", 1, NULL);
+    buffer_undo(buf);
+    buffer_insert(buf, 1, "c", 1, NULL);
+    buffer_undo(buf);
+    buffer_insert(buf, 1, "d", 1, NULL);
+    buffer_undo_earlier(buf, 0);
+    buffer_get(buf, &data, &data_len);
+    ASSERT("earlier1", 0, strncmp(data, "ac", data_len));
+    buffer_undo_earlier(buf, 0);
+    buffer_get(buf, &data, &data_len);
+    ASSERT("earlier2", 0, strncmp(data, "ab", data_len));
+    buffer_undo_earlier(buf, 0);
+    buffer_undo_earlier(buf, 0);
+    buffer_get(buf, &data, &data_len);
+    ASSERT("earlier_all", 0, data_len);
+    ASSERT("earlier_root", MLBUF_ERR, buffer_undo_earlier(buf, 0));
+    buffer_undo_later(buf, 0);
+    buffer_undo_later(buf, 0);
+    buffer_undo_later(buf, 0);
+    buffer_get(buf, &data, &data_len);
+    ASSERT("later1", 0, strncmp(data, "ac", data_len));
+    buffer_undo_later(buf, 0);
+    buffer_get(buf, &data, &data_len);
+    ASSERT("later2", 0, strncmp(data, "ad", data_len));
+    ASSERT("later_end", MLBUF_ERR, buffer_undo_later(buf, 0));
+    DL_COUNT(buf->undo_branches, branch, count);
+    ASSERT("later_branches", 2, count);
+}
@@ -0,0 +1,50 @@
+#include "test.h"
+
+char *str = "hi";
+
+void test(buffer_t *buf, mark_t *cur) {
+    char *data;
+    bint_t data_len;
+    baction_t *action;
+    int count;
+
+    buffer_set_action_group_ptr(buf, &_editor.action_group);
+    buffer_set_undo_coalesced(buf, 1);
+
+    // Typing a run of chars keeps one group and folds into one action
+    editor_start_action_group(&_editor, cmd_insert_data);
+    buffer_insert(buf, 2, "t", 1, NULL);
+    editor_start_action_group(&_editor, cmd_insert_data);
+    buffer_insert(buf, 3, "h", 1, NULL);
+    editor_start_action_group(&_editor, cmd_insert_data);
+    buffer_insert(buf, 4, "e", 1, NULL);
+    DL_COUNT(buf->actions, action, count);
+    ASSERT("type_count", 2, count);
+    ASSERT("type_data", 0, strncmp(buf->action_tail->data, "the", 3));
+
+    // Backspacing is a new run
+    editor_start_action_group(&_editor, cmd_delete_before);
+    buffer_delete(buf, 4, 1);
+    editor_start_action_group(&_editor, cmd_delete_before);
+    buffer_delete(buf, 3, 1);
+    DL_COUNT(buf->actions, action, count);
+    ASSERT("bs_count", 3, count);
+
+    // Any other cmd ends the run
+    editor_start_action_group(&_editor, cmd_move_left);
+    editor_start_action_group(&_editor, cmd_delete_before);
+    buffer_delete(buf, 2, 1);
+    DL_COUNT(buf->actions, action, count);
+    ASSERT("move_count", 4, count);
+
+    // Coarse undo takes back one run at a time
+    buffer_undo_action_group(buf);
+    buffer_get(buf, &data, &data_len);
+    ASSERT("undo1", 0, strncmp(data, "hit", data_len));
+    buffer_undo_action_group(buf);
+    buffer_get(buf, &data, &data_len);
+    ASSERT("undo2", 0, strncmp(data, "hithe", data_len));
+    buffer_undo_action_group(buf);
+    buffer_get(buf, &data, &data_len);
+    ASSERT("undo3", 0, strncmp(data, "hi", data_len));
+}
@@ -2,11 +2,101 @@
 
 char *str = "[ bracket [ test ] ] xyz";
 
+// Char by char search to check line skipping against
+static int find_naive(mark_t *mark, bint_t max_chars, bline_t **ret_line, bint_t *ret_col) {
+    char *pairs = "[](){}";
+    char brkt, targ, c;
+    char *p;
+    int dir, nest;
+    bint_t col, nchars;
+    bline_t *line;
+    brkt = mark->bline->data[mark->bline->chars[mark->col].index];
+    p = strchr(pairs, brkt);
+    if (!brkt || !p) return MLBUF_ERR;
+    dir = (p - pairs) % 2 == 0 ? 1 : -1;
+    targ = *(p + dir);
+    nest = -1;
+    nchars = 0;
+    line = mark->bline;
+    col = mark->col;
+    while (line) {
+        MLBUF_BLINE_ENSURE_CHARS(line);
+        for (; col >= 0 && col < line->char_count; col += dir) {
+            c = line->data[line->chars[col].index];
+            if (c == targ && nest == 0) {
+                *ret_line = line;
+                *ret_col = col;
+                return MLBUF_OK;
+            } else if (c == targ) {
+                nest -= 1;
+            } else if (c == brkt) {
+                nest += 1;
+            }
+            if (++nchars >= max_chars) return MLBUF_ERR;
+        }
+        line = dir > 0 ? line->next : line->prev;
+        if (line) col = dir > 0 ? 0 : MLBUF_MAX(1, line->char_count) - 1;
+    }
+    return MLBUF_ERR;
+}
+
 void test(buffer_t *buf, mark_t *cur) {
+    bline_t *line, *pair_line, *naive_line;
+    bint_t col, pair_col, naive_col, brkt;
+    bint_t max_chars[] = { 5, 40, 1024 };
+    srule_t *str_rule;
+    srule_t *comment_rule;
+    int rc, naive_rc, nmismatch, nfound;
+    size_t i;
+
     mark_move_beginning(cur);
     mark_move_bracket_pair(cur, 1024);
     ASSERT("col1", 19, cur->col);
     mark_move_by(cur, -2);
     mark_move_bracket_pair(cur, 1024);
     ASSERT("col2", 10, cur->col);
+
+    // Brackets nested across lines, with a stray closer and an empty line
+    buffer_set(buf, "f(a, [b]) {\n  if ((x)) {\n\n    y[0] = (z;\n  }\n)]\n} (\n", 52);
+    nmismatch = 0;
+    nfound = 0;
+    for (i = 0; i < sizeof(max_chars) / sizeof(max_chars[0]); i++) {
+        for (line = buf->first_line; line; line = line->next) {
+            MLBUF_BLINE_ENSURE_CHARS(line);
+            for (col = 0; col < line->char_count; col++) {
+                mark_move_to_w_bline(cur, line, col);
+                rc = mark_find_bracket_pair(cur, max_chars[i], &pair_line, &pair_col, &brkt);
+                naive_rc = find_naive(cur, max_chars[i], &naive_line, &naive_col);
+                if (rc != naive_rc || (rc == MLBUF_OK && (pair_line != naive_line || pair_col != naive_col))) {
+                    nmismatch += 1;
+                }
+                if (rc == MLBUF_OK) nfound += 1;
+            }
+        }
+    }
+    ASSERT("nmismatch", 0, nmismatch);
+    ASSERT("nfound", 1, nfound > 20 ? 1 : 0);
+
+    // Brackets in strings and comments are skipped
+    str_rule = srule_new_single("\"[^\"]*\"", sizeof("\"[^\"]*\"")-1, 0, 1, 0);
+    comment_rule = srule_new_multi("/\\*", sizeof("/\\*")-1, "\\*/", sizeof("\\*/")-1, 2, 0);
+    buffer_add_srule(buf, str_rule);
+    buffer_add_srule(buf, comment_rule);
+    buffer_set(buf, "f(\")\", /* ) \n ( */ x)\n", 22);
+    mark_move_to_w_bline(cur, buf->first_line, 1);
+    rc = mark_find_bracket_pair(cur, 1024, &pair_line, &pair_col, &brkt);
+    ASSERT("code_rc", MLBUF_OK, rc);
+    ASSERT("code_line", buf->first_line->next, pair_line);
+    ASSERT("code_col", 7, pair_col);
+
+    // A bracket in a string matches as plain text
+    mark_move_to_w_bline(cur, buf->first_line, 3);
+    rc = mark_find_bracket_pair(cur, 1024, &pair_line, &pair_col, &brkt);
+    ASSERT("str_rc", MLBUF_OK, rc);
+    ASSERT("str_col", 1, pair_col);
+
+    buffer_remove_srule(buf, str_rule);
+    buffer_remove_srule(buf, comment_rule);
+    srule_destroy(str_rule);
+    srule_destroy(comment_rule);
 }
@@ -18,4 +18,12 @@ void test(buffer_t *buf, mark_t *cur) {
     mark_move_by(cur, -1);
     ASSERT("col4", 5, cur->col);
     ASSERT("line4", buf->first_line, cur->bline);
+
+    mark_move_by(cur, -100);
+    ASSERT("col5", 0, cur->col);
+    ASSERT("line5", buf->first_line, cur->bline);
+
+    mark_move_by(cur, 100);
+    ASSERT("col6", 5, cur->col);
+    ASSERT("line6", buf->last_line, cur->bline);
 }
@@ -0,0 +1,34 @@
+#include "test.h"
+
+char *str = "";
+
+void test(buffer_t *buf, mark_t *cur) {
+    pool_t pool;
+    bint_t *objs[600];
+    bint_t *obj;
+    int nnonzero;
+    int i;
+
+    pool_init(&pool, 3, 256);
+    ASSERT("objsize", sizeof(intmax_t), pool.obj_size);
+
+    // Objects are zeroed and come from three slabs
+    nnonzero = 0;
+    for (i = 0; i < 600; i++) {
+        objs[i] = pool_alloc(&pool);
+        if (*objs[i] != 0) nnonzero += 1;
+        *objs[i] = i + 1;
+    }
+    ASSERT("zero", 0, nnonzero);
+    ASSERT("distinct", 1, objs[0] != objs[1] && objs[255] != objs[256]);
+
+    // Freed objects are reused before a new slab is allocated
+    pool_free(&pool, objs[42]);
+    obj = pool_alloc(&pool);
+    ASSERT("reuse", objs[42], obj);
+    ASSERT("rezero", 0, *obj);
+
+    pool_destroy(&pool);
+    ASSERT("slabs", NULL, pool.slabs);
+    ASSERT("free", NULL, pool.free_objs);
+}
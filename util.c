@@ -7,14 +7,25 @@
 #include <sys/time.h>
 #include <sys/wait.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <signal.h>
 #include <unistd.h>
 #include <errno.h>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <sys/mman.h>
 #include <utlist.h>
 #include "mle.h"
 
 static const unsigned char utf8_mask[6] = {0x7f, 0x1f, 0x0f, 0x07, 0x03, 0x01};
 
+static void _util_grep_dir(pcre2_code *cre, char *dir, grep_ignore_t **ignores, int out_fd, str_t *out);
+static void _util_grep_file(pcre2_code *cre, char *path, int out_fd, str_t *out);
+static void _util_grep_flush(int out_fd, str_t *out, size_t min_len);
+static void _util_grep_load_ignores(char *dir, grep_ignore_t **ignores);
+static int _util_grep_is_ignored(grep_ignore_t *ignores, char *path, int is_dir);
+static void _util_shell_exec_end_run(pid_t pid, int *readfd, int *writefd, int do_kill, int *ret_exit_code);
+
 // Run a shell command, optionally feeding stdin, collecting stdout
 // Specify timeout_s=-1 for no timeout
 int util_shell_exec(editor_t *editor, char *cmd, long timeout_s, char *input, size_t input_len, int setsid, char *opt_shell, char **optret_output, size_t *optret_output_len, int *optret_exit_code) {
@@ -137,6 +148,143 @@ int util_shell_exec(editor_t *editor, char *cmd, long timeout_s, char *input, si
     return rv;
 }
 
+// Run a shell command once per input with up to max_procs running at once,
+// collecting stdout of each run in input order. Runs that fail or time out get
+// exit code -1. Specify timeout_s=-1 for no timeout.
+int util_shell_exec_multi(editor_t *editor, char *cmd, long timeout_s, int max_procs, int nruns, char **inputs, size_t *input_lens, char **ret_outputs, size_t *ret_output_lens, int *ret_exit_codes) {
+    int rv;
+    int rc;
+    int i;
+    int next;
+    int nrunning;
+    int maxfd;
+    ssize_t nbytes;
+    pid_t *pids;
+    int *readfds;
+    int *writefds;
+    size_t *nwritten;
+    str_t *readbufs;
+    fd_set readset;
+    fd_set writeset;
+    struct timeval timeout;
+    struct timeval *timeoutptr;
+
+    pids = calloc(MLE_MAX(1, nruns), sizeof(pid_t));
+    readfds = calloc(MLE_MAX(1, nruns), sizeof(int));
+    writefds = calloc(MLE_MAX(1, nruns), sizeof(int));
+    nwritten = calloc(MLE_MAX(1, nruns), sizeof(size_t));
+    readbufs = calloc(MLE_MAX(1, nruns), sizeof(str_t));
+    for (i = 0; i < nruns; i++) {
+        readfds[i] = -1;
+        writefds[i] = -1;
+        readbufs[i].inc = -2; // double capacity on each allocation
+        ret_exit_codes[i] = -1;
+    }
+    rv = MLE_OK;
+    next = 0;
+    nrunning = 0;
+
+    while (next < nruns || nrunning > 0) {
+        // Start runs until max_procs are running
+        while (next < nruns && nrunning < max_procs) {
+            i = next++;
+            if (!util_popen2(cmd, 0, NULL, &readfds[i], input_lens[i] > 0 ? &writefds[i] : NULL, &pids[i])) {
+                MLE_SET_ERR(editor, "Failed to exec shell cmd: %s", cmd);
+                readfds[i] = -1;
+                writefds[i] = -1;
+                rv = MLE_ERR;
+                continue;
+            }
+            // Keep later runs from inheriting this run's pipes, which would
+            // hold its stdin open
+            fcntl(readfds[i], F_SETFD, FD_CLOEXEC);
+            if (writefds[i] >= 0) {
+                fcntl(writefds[i], F_SETFD, FD_CLOEXEC);
+                fcntl(writefds[i], F_SETFL, O_NONBLOCK);
+            }
+            nrunning += 1;
+        }
+        if (nrunning < 1) continue;
+
+        // Wait for any run to take input or produce output
+        FD_ZERO(&readset);
+        FD_ZERO(&writeset);
+        maxfd = -1;
+        for (i = 0; i < next; i++) {
+            if (readfds[i] >= 0) {
+                FD_SET(readfds[i], &readset);
+                maxfd = MLE_MAX(maxfd, readfds[i]);
+            }
+            if (writefds[i] >= 0) {
+                FD_SET(writefds[i], &writeset);
+                maxfd = MLE_MAX(maxfd, writefds[i]);
+            }
+        }
+        if (timeout_s >= 0) {
+            timeout.tv_sec = timeout_s;
+            timeout.tv_usec = 0;
+            timeoutptr = &timeout;
+        } else {
+            timeoutptr = NULL;
+        }
+        rc = select(maxfd + 1, &readset, &writeset, NULL, timeoutptr);
+        if (rc < 0 && errno == EINTR) {
+            continue;
+        } else if (rc <= 0) {
+            // Timed out or err on select. Kill running runs.
+            if (rc < 0) MLE_SET_ERR(editor, "select error: %s", strerror(errno));
+            for (i = 0; i < next; i++) {
+                if (readfds[i] < 0) continue;
+                _util_shell_exec_end_run(pids[i], &readfds[i], &writefds[i], 1, &ret_exit_codes[i]);
+                nrunning -= 1;
+            }
+            rv = MLE_ERR;
+            if (rc < 0) break;
+            continue;
+        }
+
+        for (i = 0; i < next; i++) {
+            // Write a chunk of input
+            if (writefds[i] >= 0 && FD_ISSET(writefds[i], &writeset)) {
+                nbytes = write(writefds[i], inputs[i] + nwritten[i], input_lens[i] - nwritten[i]);
+                if (nbytes > 0) nwritten[i] += nbytes;
+                if ((nbytes < 0 && errno != EAGAIN) || nwritten[i] >= input_lens[i]) {
+                    close(writefds[i]);
+                    writefds[i] = -1;
+                }
+            }
+
+            // Read a kilobyte of output, reaping the run on EOF
+            if (readfds[i] >= 0 && FD_ISSET(readfds[i], &readset)) {
+                str_ensure_cap(&readbufs[i], readbufs[i].len + 1024);
+                nbytes = read(readfds[i], readbufs[i].data + readbufs[i].len, 1024);
+                if (nbytes > 0) {
+                    readbufs[i].len += nbytes;
+                } else {
+                    _util_shell_exec_end_run(pids[i], &readfds[i], &writefds[i], nbytes < 0, &ret_exit_codes[i]);
+                    if (ret_exit_codes[i] < 0) rv = MLE_ERR;
+                    nrunning -= 1;
+                }
+            }
+        }
+    }
+
+    for (i = 0; i < nruns; i++) {
+        ret_outputs[i] = readbufs[i].data;
+        ret_output_lens[i] = readbufs[i].len;
+    }
+    free(pids);
+    free(readfds);
+    free(writefds);
+    free(nwritten);
+    free(readbufs);
+
+    // Force redraw to correct artifacts from child processes writing to stderr
+    if (!_editor.headless_mode) editor_force_redraw(&_editor);
+
+    return rv;
+}
+
 // Like popen, but more control over pipes. Returns 1 on success, 0 on failure.
 int util_popen2(char *cmd, int do_setsid, char *opt_shell, int *optret_fdread, int *optret_fdwrite, pid_t *optret_pid) {
     pid_t pid;
@@ -204,6 +352,237 @@ int util_get_bracket_pair(uint32_t ch, int *optret_is_closing) {
     return 0;
 }
 
+// Recursively grep path, writing "path:linenum:line" to out_fd for each matching
+// line in batches of MLE_GREP_BATCH_BYTES. Skip binary files, .git dirs, and
+// paths ignored by .gitignore files.
+int util_grep(pcre2_code *cre, char *path, int out_fd) {
+    grep_ignore_t *ignores;
+    str_t out = {0};
+
+    ignores = NULL;
+    if (util_is_dir(path)) {
+        _util_grep_dir(cre, path, &ignores, out_fd, &out);
+    } else {
+        _util_grep_file(cre, path, out_fd, &out);
+    }
+    _util_grep_flush(out_fd, &out, 0);
+
+    str_free(&out);
+    return MLE_OK;
+}
+
+// Grep entries of dir in sorted order
+static void _util_grep_dir(pcre2_code *cre, char *dir, grep_ignore_t **ignores, int out_fd, str_t *out) {
+    struct dirent **ents;
+    struct stat st;
+    grep_ignore_t *tail;
+    grep_ignore_t *ignore;
+    char *path;
+    int num_ents;
+    int i;
+
+    tail = *ignores ? (*ignores)->prev : NULL;
+    _util_grep_load_ignores(dir, ignores);
+
+    num_ents = scandir(dir, &ents, NULL, alphasort);
+    for (i = 0; i < num_ents; i++) {
+        if (strcmp(ents[i]->d_name, ".") == 0
+            || strcmp(ents[i]->d_name, "..") == 0
+            || strcmp(ents[i]->d_name, ".git") == 0
+        ) {
+            free(ents[i]);
+            continue;
+        }
+        asprintf(&path, "%s/%s", dir, ents[i]->d_name);
+        free(ents[i]);
+        if (!path) continue;
+        if (lstat(path, &st) == 0) {
+            if (S_ISDIR(st.st_mode) && !_util_grep_is_ignored(*ignores, path, 1)) {
+                _util_grep_dir(cre, path, ignores, out_fd, out);
+            } else if (S_ISREG(st.st_mode) && !_util_grep_is_ignored(*ignores, path, 0)) {
+                _util_grep_file(cre, path, out_fd, out);
+            }
+        }
+        free(path);
+    }
+    if (num_ents >= 0) free(ents);
+
+    // Pop ignores loaded for this dir
+    while (*ignores && (*ignores)->prev != tail) {
+        ignore = (*ignores)->prev;
+        DL_DELETE(*ignores, ignore);
+        free(ignore->base);
+        free(ignore->pattern);
+        free(ignore);
+    }
+}
+
+// Grep a single file
+static void _util_grep_file(pcre2_code *cre, char *path, int out_fd, str_t *out) {
+    int fd;
+    int rc;
+    struct stat st;
+    char *data;
+    char *newline;
+    char linenum_str[32];
+    size_t size;
+    size_t offset;
+    size_t count_offset;
+    size_t line_start;
+    size_t line_end;
+    PCRE2_SIZE *ovector;
+    bint_t linenum;
+
+    // Map file
+    if ((fd = open(path, O_RDONLY)) < 0) return;
+    if (fstat(fd, &st) != 0 || st.st_size < 1) {
+        close(fd);
+        return;
+    }
+    size = (size_t)st.st_size;
+    data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return;
+
+    // Skip binary files
+    if (memchr(data, '\0', MLE_MIN(size, 8192)) != NULL) {
+        munmap(data, size);
+        return;
+    }
+
+    // Match whole file at once, then find the line around each match
+    offset = 0;
+    count_offset = 0;
+    linenum = 1;
+    while (offset < size) {
+        rc = pcre2_match(cre, (PCRE2_SPTR)data, (PCRE2_SIZE)size, (PCRE2_SIZE)offset, 0, pcre2_md, NULL);
+        if (rc < 0) break;
+        ovector = pcre2_get_ovector_pointer(pcre2_md);
+        line_start = ovector[0];
+        while (line_start > offset && data[line_start - 1] != '\n') line_start -= 1;
+        newline = memchr(data + ovector[0], '\n', size - ovector[0]);
+        line_end = newline ? (size_t)(newline - data) : size;
+
+        // If match spans lines, retry within the line only
+        if (ovector[1] > line_end) {
+            rc = pcre2_match(cre, (PCRE2_SPTR)data, (PCRE2_SIZE)line_end, (PCRE2_SIZE)line_start, 0, pcre2_md, NULL);
+            if (rc < 0) {
+                offset = line_end + 1;
+                continue;
+            }
+        }
+
+        // Count lines up to match
+        while (count_offset < line_start && (newline = memchr(data + count_offset, '\n', line_start - count_offset)) != NULL) {
+            linenum += 1;
+            count_offset = (size_t)(newline - data) + 1;
+        }
+
+        // Append result
+        snprintf(linenum_str, sizeof(linenum_str), ":%" PRIdMAX ":", linenum);
+        str_append(out, path);
+        str_append(out, linenum_str);
+        str_append_len(out, data + line_start, line_end - line_start);
+        str_append_char(out, '\n');
+        _util_grep_flush(out_fd, out, MLE_GREP_BATCH_BYTES);
+        offset = line_end + 1;
+    }
+
+    munmap(data, size);
+}
+
+// Write out buffered grep results once at least min_len bytes are pending
+static void _util_grep_flush(int out_fd, str_t *out, size_t min_len) {
+    size_t offset;
+    ssize_t nbytes;
+    if (out->len < 1 || out->len < min_len) return;
+    offset = 0;
+    while (offset < out->len) {
+        nbytes = write(out_fd, out->data + offset, out->len - offset);
+        if (nbytes < 0 && errno == EINTR) continue;
+        if (nbytes < 1) break; // Reader went away
+        offset += (size_t)nbytes;
+    }
+    out->len = 0;
+}
+
+// Push patterns from dir/.gitignore onto ignores
+static void _util_grep_load_ignores(char *dir, grep_ignore_t **ignores) {
+    FILE *fp;
+    char *path;
+    char *line;
+    char *pattern;
+    size_t line_cap;
+    ssize_t line_len;
+    grep_ignore_t *ignore;
+
+    asprintf(&path, "%s/.gitignore", dir);
+    if (!path) return;
+    fp = fopen(path, "r");
+    free(path);
+    if (!fp) return;
+
+    line = NULL;
+    line_cap = 0;
+    while ((line_len = getline(&line, &line_cap, fp)) >= 0) {
+        // Trim trailing whitespace
+        while (line_len > 0 && strchr("\r\n\t ", line[line_len - 1])) line[--line_len] = '\0';
+        if (line_len < 1 || line[0] == '#') continue;
+
+        ignore = calloc(1, sizeof(grep_ignore_t));
+        pattern = line;
+        if (*pattern == '!') {
+            ignore->is_negated = 1;
+            pattern += 1;
+        }
+        if (pattern[strlen(pattern) - 1] == '/') {
+            ignore->is_dir_only = 1;
+            pattern[strlen(pattern) - 1] = '\0';
+        }
+        if (strncmp(pattern, "**/", 3) == 0) {
+            pattern += 3;
+        } else if (*pattern == '/') {
+            ignore->is_anchored = 1;
+            pattern += 1;
+        } else if (strchr(pattern, '/')) {
+            ignore->is_anchored = 1;
+        }
+        if (*pattern == '\0') {
+            free(ignore);
+            continue;
+        }
+        ignore->base = strdup(dir);
+        ignore->pattern = strdup(pattern);
+        DL_APPEND(*ignores, ignore);
+    }
+    free(line);
+    fclose(fp);
+}
+
+// Return 1 if path is ignored. The last matching pattern wins.
+static int _util_grep_is_ignored(grep_ignore_t *ignores, char *path, int is_dir) {
+    grep_ignore_t *ignore;
+    char *rel;
+    char *name;
+    int is_ignored;
+
+    is_ignored = 0;
+    name = strrchr(path, '/');
+    name = name ? name + 1 : path;
+    DL_FOREACH(ignores, ignore) {
+        if (ignore->is_dir_only && !is_dir) continue;
+        if (ignore->is_anchored) {
+            rel = path + strlen(ignore->base);
+            if (*rel == '/') rel += 1;
+            if (fnmatch(ignore->pattern, rel, FNM_PATHNAME) != 0) continue;
+        } else if (fnmatch(ignore->pattern, name, 0) != 0) {
+            continue;
+        }
+        is_ignored = !ignore->is_negated;
+    }
+    return is_ignored;
+}
+
 // Return 1 if path is file
 int util_is_file(char *path, char *opt_mode, FILE **optret_file) {
     struct stat sb;
@@ -446,6 +825,15 @@ int tb_printf_attr(bview_rect_t rect, int x, int y, const char *fmt, ...) {
     return c;
 }
 
+// Fill a rect of cells with default-styled blanks
+void tb_clear_rect(int x, int y, int w, int h) {
+    int i, j;
+    for (j = y; j < y + h; j++) {
+        for (i = x; i < x + w; i++) {
+            tb_set_cell(i, j, ' ', 0, 0);
+        }
+    }
+}
 
 // Zero-fill realloc
 void *recalloc(void *ptr, size_t orig_num, size_t new_num, size_t el_size) {
@@ -655,6 +1043,53 @@ void str_append_replace_with_backrefs(str_t *str, char *subj, char *repl, int pc
     }
 }
 
+// Set up an empty pool of obj_size objects, allocated slab_nobjs at a time
+void pool_init(pool_t *pool, size_t obj_size, size_t slab_nobjs) {
+    memset(pool, 0, sizeof(pool_t));
+    // Round up so every slot can hold a link and stays aligned
+    pool->obj_size = ((MLBUF_MAX(obj_size, sizeof(void *)) + sizeof(intmax_t) - 1) / sizeof(intmax_t)) * sizeof(intmax_t);
+    pool->slab_nobjs = slab_nobjs;
+}
+
+// Return a zeroed object from pool
+void *pool_alloc(pool_t *pool) {
+    char *slab;
+    char *obj;
+    size_t i;
+    if (!pool->free_objs) {
+        // First slot of each slab links to the previous slab
+        slab = malloc((pool->slab_nobjs + 1) * pool->obj_size);
+        *(void **)slab = pool->slabs;
+        pool->slabs = slab;
+        for (i = pool->slab_nobjs; i >= 1; i--) {
+            obj = slab + (i * pool->obj_size);
+            *(void **)obj = pool->free_objs;
+            pool->free_objs = obj;
+        }
+    }
+    obj = pool->free_objs;
+    pool->free_objs = *(void **)obj;
+    memset(obj, 0, pool->obj_size);
+    return obj;
+}
+
+// Return obj to pool for reuse
+void pool_free(pool_t *pool, void *obj) {
+    *(void **)obj = pool->free_objs;
+    pool->free_objs = obj;
+}
+
+// Free every object in pool at once
+void pool_destroy(pool_t *pool) {
+    void *slab;
+    while (pool->slabs) {
+        slab = pool->slabs;
+        pool->slabs = *(void **)slab;
+        free(slab);
+    }
+    pool->free_objs = NULL;
+}
+
 // Return a new aproc_t
 aproc_t *aproc_new(editor_t *editor, void *owner, aproc_t **owner_aproc, char *shell_cmd, int rw, aproc_cb_t callback) {
     aproc_t *aproc;
@@ -684,6 +1119,57 @@ aproc_new_failure:
     return NULL;
 }
 
+// Return a new aproc_t that runs util_grep in a forked child, feeding results
+// back through a pipe like an external grep would
+aproc_t *aproc_new_grep(editor_t *editor, void *owner, aproc_t **owner_aproc, char *re, char *path, aproc_cb_t callback) {
+    aproc_t *aproc;
+    pcre2_code *cre;
+    int errcode;
+    PCRE2_SIZE erroffset;
+    int pipefd[2];
+    pid_t pid;
+
+    // Compile up front so a bad regex is reported here
+    cre = pcre2_compile((PCRE2_SPTR)re, (PCRE2_SIZE)strlen(re), PCRE2_CASELESS | PCRE2_MULTILINE | PCRE2_NO_AUTO_CAPTURE, &errcode, &erroffset, NULL);
+    if (!cre) {
+        MLE_SET_ERR(editor, "grep: Invalid regex: %s", re);
+        return NULL;
+    }
+    pcre2_jit_compile(cre, PCRE2_JIT_COMPLETE); // Falls back to interpreter if JIT is unavailable
+
+    if (pipe(pipefd) < 0) {
+        MLE_SET_ERR(editor, "grep: pipe failed: %s", strerror(errno));
+        pcre2_code_free(cre);
+        return NULL;
+    }
+    if ((pid = fork()) < 0) {
+        MLE_SET_ERR(editor, "grep: fork failed: %s", strerror(errno));
+        close(pipefd[0]);
+        close(pipefd[1]);
+        pcre2_code_free(cre);
+        return NULL;
+    } else if (pid == 0) {
+        // Child
+        close(pipefd[0]);
+        util_grep(cre, path, pipefd[1]);
+        close(pipefd[1]);
+        _exit(EXIT_SUCCESS);
+    }
+    close(pipefd[1]);
+    pcre2_code_free(cre);
+
+    aproc = calloc(1, sizeof(aproc_t));
+    aproc->editor = editor;
+    aproc_set_owner(aproc, owner, owner_aproc);
+    aproc->pid = pid;
+    aproc->rfd = pipefd[0];
+    aproc->rpipe = fdopen(aproc->rfd, "r");
+    setvbuf(aproc->rpipe, NULL, _IONBF, 0);
+    aproc->callback = callback;
+    DL_APPEND(editor->aprocs, aproc);
+    return aproc;
+}
+
 // Set aproc owner
 int aproc_set_owner(aproc_t *aproc, void *owner, aproc_t **owner_aproc) {
     if (aproc->owner_aproc) {
@@ -704,8 +1190,15 @@ int aproc_destroy(aproc_t *aproc, int preempt) {
         if (aproc->wfd) close(aproc->wfd);
         if (aproc->pid) kill(aproc->pid, SIGTERM);
     }
-    if (aproc->rpipe) pclose(aproc->rpipe);
-    if (aproc->wpipe) pclose(aproc->wpipe);
+    if (aproc->pid) {
+        // Pipes were fdopen'd, so close them and reap the child ourselves
+        if (aproc->rpipe) fclose(aproc->rpipe);
+        if (aproc->wpipe) fclose(aproc->wpipe);
+        waitpid(aproc->pid, NULL, 0);
+    } else {
+        if (aproc->rpipe) pclose(aproc->rpipe);
+        if (aproc->wpipe) pclose(aproc->wpipe);
+    }
     free(aproc);
     return MLE_OK;
 }
@@ -724,17 +1217,17 @@ int aproc_drain_all(aproc_t *aprocs, int *ttyfd) {
     // Exit early if no aprocs
     if (!aprocs) return 0;
 
-    // Open ttyfd if not already open
+    // Open ttyfd if not already open. Without a tty (e.g., headless with no
+    // controlling terminal) just wait on the async procs.
     if (!*ttyfd) {
         if ((*ttyfd = open("/dev/tty", O_RDONLY)) < 0) {
-            // TODO error
-            return 0;
+            *ttyfd = -1;
         }
     }
 
     // Add tty to readfds
     FD_ZERO(&readfds);
-    FD_SET(*ttyfd, &readfds);
+    if (*ttyfd >= 0) FD_SET(*ttyfd, &readfds);
 
     // Add async procs to readfds
     // Simultaneously check for solo, which takes precedence over everything
@@ -752,7 +1245,7 @@ int aproc_drain_all(aproc_t *aprocs, int *ttyfd) {
         return 1; // Nothing to read, call again
     }
 
-    if (FD_ISSET(*ttyfd, &readfds)) {
+    if (*ttyfd >= 0 && FD_ISSET(*ttyfd, &readfds)) {
         // Immediately give priority to user input
         return 0;
     } else {
@@ -811,3 +1304,19 @@ int utf8_char_to_unicode(uint32_t *out, const char *c, const char *stop) {
     *out = result;
     return (int)len;
 }
+
+// Close pipes of a shell run and reap it, killing it first if do_kill is set
+static void _util_shell_exec_end_run(pid_t pid, int *readfd, int *writefd, int do_kill, int *ret_exit_code) {
+    int exit_status;
+    if (*readfd >= 0) close(*readfd);
+    if (*writefd >= 0) close(*writefd);
+    *readfd = -1;
+    *writefd = -1;
+    if (do_kill) kill(pid, SIGKILL);
+    exit_status = 0;
+    if (waitpid(pid, &exit_status, 0) < 0 || do_kill || !WIFEXITED(exit_status)) {
+        *ret_exit_code = -1;
+    } else {
+        *ret_exit_code = WEXITSTATUS(exit_status);
+    }
+}